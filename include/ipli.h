@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////
+//
+// libipli
+//
+// Embeddable IPL interpreter. A program is compiled once and can then be
+// run any number of times, by any number of runtimes (eg one per thread).
+// All state lives in the runtime, errors are reported by return values.
+//
+///////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct bytecode* IpliProgram;
+typedef struct runtime* IpliRuntime;
+
+typedef enum {
+	IPLI_OK = 0,
+	IPLI_ERROR_SYNTAX,		// compilation failed
+	IPLI_ERROR_INPUT,		// a read statement failed, execution stopped
+	IPLI_ERROR_SIZE,		// a whole-array operation on arrays of different sizes, execution stopped
+	IPLI_ERROR_DIVISION,	// a division by zero (or INT_MIN / -1), execution stopped
+} IpliStatus;
+
+// Output and input of a running program. Output is buffered by the runtime, write is
+// called when the buffer fills up, before each read and at the end of the run.
+typedef struct {
+	void (*write)(void* data, const char* buf, int len);
+	bool (*read)(void* data, int* value);		// false if no more input
+	void* data;
+} IpliIO;
+
+// Compiles source (length bytes). On error, if error != NULL, a message is stored there.
+
+IpliStatus ipli_compile(const char* source, size_t length, IpliProgram* program, char* error, size_t error_size);
+
+// Must be called after all runtimes of the program are destroyed.
+
+void ipli_program_destroy(IpliProgram program);
+
+// Creates a runtime with its own memory. If io == NULL stdin/stdout are used,
+// seed initializes the runtime's random generator.
+
+IpliRuntime ipli_runtime_create(IpliProgram program, const IpliIO* io, uint64_t seed);
+
+// Runs the program with the given arguments. Memory is reset before each run,
+// so that every run starts from the initial state.
+
+IpliStatus ipli_run(IpliRuntime runtime, int arg_n, const char* args[]);
+
+void ipli_runtime_destroy(IpliRuntime runtime);
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+#
+# Benchmark suite. Runs each program of misc/programs at several input sizes with each
+# implementation (the binaries of misc/implementations and ipli-fast in several engine
+# configurations), repeating every run, and reports the min, median and standard
+# deviation of the wall time. The output of each run is compared to the output of the
+# reference implementation (ipl by default), except for programs that use random.
+#
+# Results can be stored as CSV and JSON (with the commit and machine they were taken on),
+# and two JSON results compared with --compare, eg before and after a change:
+#
+#   bench.py --json before.json
+#   ...
+#   bench.py --json after.json
+#   bench.py --compare before.json after.json
+#
+# Besides misc/programs, the suite has synthetic programs of iplgen.py (named gen-*):
+# gen-startup is never executed (so only load, parse, code generation and threading are
+# measured) and gen-loops runs nested loops over a mix of statements, up to 100k lines.
+#
+# With --stats, the ipli-fast configurations are also run once with --stats, and the JSON
+# results get its compile phase times, thread size and run statistics.
+#
+# An implementation that times out at some size is not run at the larger sizes of the
+# same program. Runs that fail (eg ipl needs a 32-bit toolchain) are reported as errors.
+#
+# usage: bench.py [--programs P ...] [--impls I ...] [--sizes S ...] [--runs K]
+#                 [--timeout SECS] [--reference I] [--stats] [--csv FILE] [--json FILE]
+#        bench.py --compare OLD.json NEW.json
+
+import argparse
+import csv
+import datetime
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import iplgen
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+PROGRAMS_DIR = os.path.join(ROOT, 'misc', 'programs')
+IMPLS_DIR = os.path.join(ROOT, 'misc', 'implementations')
+IPLI_FAST = os.path.join(ROOT, 'ipli-fast')
+
+SIZES = ['small', 'medium', 'large']
+
+# program: (arguments or stdin of each size, uses random)
+# a size given as a string is fed to stdin (for programs that read their input)
+PROGRAMS = {
+	'nqueens':    ({'small': ['10'], 'medium': ['16'], 'large': ['20']}, False),
+	'countdivs':  ({'small': ['1', '5000'], 'medium': ['1', '20000'], 'large': ['1', '50000']}, False),
+	'primes':     ({'small': '10000', 'medium': '30000', 'large': '100000'}, False),
+	'humble':     ({'small': '500', 'medium': '1500', 'large': '3000'}, False),
+	'matrmult':   ({'small': ['50', '50', '50'], 'medium': ['150', '150', '150'], 'large': ['300', '300', '300']}, True),
+	'selectsort': ({'small': ['1000'], 'medium': ['5000'], 'large': ['15000']}, True),
+	'factorize':  ({'small': [], 'medium': [], 'large': []}, True),
+}
+
+# generated program: iplgen.generate arguments of each size
+LOOPS_MIX = {'add': 3, 'sub': 1, 'mul': 1, 'mod': 1, 'array': 2, 'if': 1}
+GENERATED = {
+	'gen-startup': {size: dict(lines=lines, depth=10, vars=100, dead=True, seed=1)
+		for size, lines in [('small', 10000), ('medium', 50000), ('large', 100000)]},
+	'gen-loops': {size: dict(lines=lines, depth=4, vars=50, dead=False, seed=1, arrays=4, loops=0.5, trips=10, mix=LOOPS_MIX)
+		for size, lines in [('small', 2000), ('medium', 20000), ('large', 100000)]},
+}
+for name in GENERATED:
+	PROGRAMS[name] = ({size: [] for size in SIZES}, False)
+
+# implementation: command before the program's file
+IMPLS = {
+	'ipl':                  [os.path.join(IMPLS_DIR, 'ipl')],
+	'ipli-reference':       [os.path.join(IMPLS_DIR, 'ipli-reference')],
+	'ipli-k08':             [os.path.join(IMPLS_DIR, 'ipli-k08')],
+	'ipli-k08-optimized':   [os.path.join(IMPLS_DIR, 'ipli-k08-optimized')],
+	'ipli-fast':            [IPLI_FAST],
+	'ipli-fast-cache':      [IPLI_FAST, '-c'],
+	'ipli-fast-parallel':   [IPLI_FAST, '-p', str(os.cpu_count() or 1)],
+	'ipli-fast-noprefetch': [IPLI_FAST, '--prefetch', '0'],
+	'ipli-fast-token':      [IPLI_FAST + '-token'],			# dispatch backends, see make backends
+	'ipli-fast-switch':     [IPLI_FAST + '-switch'],
+	'ipli-fast-tailcall':   [IPLI_FAST + '-tailcall'],
+}
+
+# the slow ones are left out by default, see --impls
+DEFAULT_IMPLS = ['ipl', 'ipli-k08-optimized', 'ipli-fast', 'ipli-fast-cache', 'ipli-fast-parallel', 'ipli-fast-noprefetch']
+
+FIELDS = ['program', 'size', 'args', 'impl', 'status', 'runs', 'min', 'median', 'stdev', 'output']
+
+
+# runs once, returns (status, seconds, stdout)
+def run_once(command, stdin, timeout):
+	start = time.perf_counter()
+	try:
+		result = subprocess.run(command, input=stdin, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, timeout=timeout)
+	except subprocess.TimeoutExpired:
+		return 'timeout', timeout, None
+	except OSError:
+		return 'error', 0, None
+	seconds = time.perf_counter() - start
+	return ('ok' if result.returncode == 0 else 'error'), seconds, result.stdout
+
+
+# the file of program at size, generated ones are written in directory
+def program_path(program, size, directory):
+	if program not in GENERATED:
+		return os.path.join(PROGRAMS_DIR, program + '.ipl')
+	path = os.path.join(directory, '%s-%s.ipl' % (program, size))
+	if not os.path.exists(path):
+		with open(path, 'w') as f:
+			f.write(iplgen.generate(**GENERATED[program][size]))
+	return path
+
+
+# runs an ipli-fast command with --stats, returns the statistics (None if the run fails)
+def run_stats(command, stdin, timeout):
+	try:
+		result = subprocess.run(command[:1] + ['--stats'] + command[1:], input=stdin,
+			stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, timeout=timeout)
+		stderr = result.stderr.decode()
+		return json.loads(stderr[stderr.rindex('{"source"'):])
+	except (subprocess.TimeoutExpired, ValueError):
+		return None
+
+
+# runs `runs` times, returns the result row (without output check) and the output
+def measure(program, size, path, impl, runs, timeout, stats):
+	sizes, _ = PROGRAMS[program]
+	args = sizes[size]
+	stdin = (args + '\n').encode() if isinstance(args, str) else None
+	command = IMPLS[impl] + [path] + ([] if isinstance(args, str) else args)
+
+	times = []
+	outputs = set()
+	status = 'ok'
+	for _ in range(runs):
+		status, seconds, output = run_once(command, stdin, timeout)
+		if status != 'ok':
+			break
+		times.append(seconds)
+		outputs.add(output)
+
+	row = {
+		'program': program,
+		'size': size,
+		'args': ('< ' + args) if isinstance(args, str) else ' '.join(args) if program not in GENERATED else
+			'%d lines' % GENERATED[program][size]['lines'],
+		'impl': impl,
+		'status': status,
+		'runs': len(times),
+		'min': min(times) if times else None,
+		'median': statistics.median(times) if times else None,
+		'stdev': statistics.stdev(times) if len(times) > 1 else 0.0 if times else None,
+		'output': '',
+	}
+	if len(outputs) > 1:
+		row['output'] = 'unstable'
+	if stats and status == 'ok' and IMPLS[impl][0].startswith(IPLI_FAST):
+		row['stats'] = run_stats(command, stdin, timeout)
+	return row, (outputs.pop() if status == 'ok' and len(outputs) == 1 else None)
+
+
+def print_row(row):
+	time_fmt = lambda t: '%.4f' % t if t is not None else '-'
+	print('%-11s %-6s %-20s %-21s %-7s %10s %10s %10s  %s' % (
+		row['program'], row['size'], row['args'][:20], row['impl'], row['status'],
+		time_fmt(row['min']), time_fmt(row['median']), time_fmt(row['stdev']), row['output']))
+	sys.stdout.flush()
+
+
+def git_commit():
+	try:
+		return subprocess.run(['git', '-C', ROOT, 'rev-parse', '--short', 'HEAD'], stdout=subprocess.PIPE,
+			stderr=subprocess.DEVNULL, check=True).stdout.decode().strip()
+	except (OSError, subprocess.CalledProcessError):
+		return None
+
+
+def run_suite(args):
+	with tempfile.TemporaryDirectory() as directory:
+		return run_programs(args, directory)
+
+
+def run_programs(args, directory):
+	rows = []
+	print('%-11s %-6s %-20s %-21s %-7s %10s %10s %10s  %s' % (
+		'program', 'size', 'args', 'impl', 'status', 'min (s)', 'median (s)', 'stdev', 'output'))
+	for program in args.programs:
+		_, random = PROGRAMS[program]
+		timed_out = set()
+		for size in args.sizes:
+			path = program_path(program, size, directory)
+			# the reference is run first, its output is what the others are checked against
+			impls = sorted(args.impls, key=lambda impl: impl != args.reference)
+			expected = None
+			for impl in impls:
+				if impl in timed_out:
+					continue
+				row, output = measure(program, size, path, impl, args.runs, args.timeout, args.stats)
+				if row['status'] == 'timeout':
+					timed_out.add(impl)
+				if impl == args.reference:
+					expected = output
+				elif row['status'] == 'ok' and not random and not row['output']:
+					row['output'] = 'unchecked' if expected is None else 'ok' if output == expected else 'DIFFERS'
+				rows.append(row)
+				print_row(row)
+
+	if args.csv:
+		with open(args.csv, 'w', newline='') as f:
+			writer = csv.DictWriter(f, fieldnames=FIELDS, extrasaction='ignore')
+			writer.writeheader()
+			writer.writerows(rows)
+	if args.json:
+		with open(args.json, 'w') as f:
+			json.dump({
+				'commit': git_commit(),
+				'date': datetime.datetime.now().isoformat(timespec='seconds'),
+				'machine': platform.node(),
+				'processor': platform.processor() or platform.machine(),
+				'cpus': os.cpu_count(),
+				'runs': args.runs,
+				'results': rows,
+			}, f, indent=1)
+			f.write('\n')
+
+	return not any(row['output'] == 'DIFFERS' for row in rows)
+
+
+# prints the median of each run in both results, and the speedup of new
+def compare(old_file, new_file):
+	with open(old_file) as f:
+		old = json.load(f)
+	with open(new_file) as f:
+		new = json.load(f)
+	key = lambda row: (row['program'], row['size'], row['impl'])
+	old_rows = {key(row): row for row in old['results']}
+
+	print('old: %s (%s), new: %s (%s)' % (old.get('commit'), old.get('date'), new.get('commit'), new.get('date')))
+	print('%-11s %-6s %-21s %10s %10s %8s' % ('program', 'size', 'impl', 'old (s)', 'new (s)', 'speedup'))
+	for row in new['results']:
+		old_row = old_rows.get(key(row))
+		if old_row is None or old_row['median'] is None or row['median'] is None:
+			continue
+		print('%-11s %-6s %-21s %10.4f %10.4f %7.2fx' % (
+			row['program'], row['size'], row['impl'], old_row['median'], row['median'], old_row['median'] / row['median']))
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Benchmark the implementations on misc/programs')
+	parser.add_argument('--programs', nargs='+', choices=PROGRAMS, default=list(PROGRAMS))
+	parser.add_argument('--impls', nargs='+', choices=IMPLS, default=DEFAULT_IMPLS)
+	parser.add_argument('--sizes', nargs='+', choices=SIZES, default=SIZES)
+	parser.add_argument('--runs', type=int, default=5)
+	parser.add_argument('--timeout', type=float, default=60, help='seconds, per run')
+	parser.add_argument('--reference', choices=IMPLS, default='ipl', help='implementation whose output is expected')
+	parser.add_argument('--stats', action='store_true', help='add the --stats of the ipli-fast runs to the JSON results')
+	parser.add_argument('--csv', help='write the results to this CSV file')
+	parser.add_argument('--json', help='write the results to this JSON file')
+	parser.add_argument('--compare', nargs=2, metavar=('OLD', 'NEW'), help='compare two JSON results')
+	args = parser.parse_args()
+
+	if args.compare:
+		compare(*args.compare)
+		return
+	if args.reference not in args.impls:
+		args.impls.append(args.reference)
+	sys.exit(0 if run_suite(args) else 1)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Generator of synthetic IPL programs, for benchmarking.
+#
+# The program is a sequence of "towers": blocks nested up to --depth levels, with a
+# statement at every level on the way in and on the way back. By default the blocks are
+# if blocks and the statements additions and subtractions of --vars variables. With
+# --loops a share of the blocks are while loops of --trips iterations each (so nested ones
+# multiply), and --mix sets the kinds of statements and their weights, eg --mix add=2,array=1:
+#
+#   assign  v1 = v2            add  v1 = v2 + v3        sub  v1 = v2 - v3
+#   mul     v1 = v2 * v3       div  v1 = v2 / 7         mod  v1 = v2 % 7
+#   array   a1[i] = v1 + v2, or v1 = a1[i] + v2 (i is the counter of the enclosing loop, or a constant)
+#   if      if v1 < v2, with an assignment in its body
+#
+# The generated programs always terminate and access arrays (--arrays of them, with
+# --array-size elements) within their bounds. With --dead the whole program is placed in a
+# branch that is never taken, so running it measures startup (load, parse, code generation,
+# threading) only.
+#
+# usage: iplgen.py [--lines N] [--depth D] [--vars V] [--arrays A] [--array-size S]
+#                  [--loops SHARE] [--trips T] [--mix KIND=WEIGHT,...] [--dead] [--seed S]
+
+import argparse
+import random
+import sys
+
+KINDS = ['assign', 'add', 'sub', 'mul', 'div', 'mod', 'array', 'if']
+
+
+def parse_mix(text):
+	mix = {}
+	for item in text.split(','):
+		kind, _, weight = item.partition('=')
+		if kind not in KINDS:
+			raise ValueError('unknown statement kind %s' % kind)
+		mix[kind] = float(weight or 1)
+	return mix
+
+
+def generate(lines, depth, vars, dead, seed, arrays=0, array_size=64, loops=0.0, trips=10, mix=None):
+	rnd = random.Random(seed)
+	out = []
+	var = lambda: 'v%d' % rnd.randrange(vars)
+	array_size = max(array_size, trips)
+	if arrays == 0 and mix is not None:
+		mix = {kind: weight for kind, weight in mix.items() if kind != 'array'}
+
+	def emit(level, text):
+		out.append('\t' * level + text)
+
+	# a statement of the mix at level, inside the loops with the given counters
+	def statement(level, counters):
+		kind = rnd.choices(list(mix), weights=list(mix.values()))[0]
+		if kind == 'assign':
+			emit(level, '%s = %s' % (var(), var()))
+		elif kind in ('add', 'sub', 'mul'):
+			emit(level, '%s = %s %s %s' % (var(), var(), {'add': '+', 'sub': '-', 'mul': '*'}[kind], var()))
+		elif kind in ('div', 'mod'):
+			emit(level, '%s = %s %s %d' % (var(), var(), '/' if kind == 'div' else '%', rnd.randrange(2, 10)))
+		elif kind == 'array':
+			array = 'a%d' % rnd.randrange(arrays)
+			index = rnd.choice(counters) if counters else str(rnd.randrange(array_size))
+			if rnd.random() < 0.5:
+				emit(level, '%s[%s] = %s + %s' % (array, index, var(), var()))
+			else:
+				emit(level, '%s = %s[%s] + %s' % (var(), array, index, var()))
+		else:
+			emit(level, 'if %s < %s' % (var(), var()))
+			emit(level + 1, '%s = %s + %s' % (var(), var(), var()))
+
+	for i in range(arrays):
+		emit(0, 'new a%d[%d]' % (i, array_size))
+	if mix is not None:
+		for i in range(vars):		# so that the statements do not just compute zeros
+			emit(0, 'v%d = %d' % (i, rnd.randrange(1, 100)))
+
+	base = 0
+	if dead:
+		emit(0, 'zero = 0')
+		emit(0, 'if zero != zero')
+		base = 1
+
+	while len(out) < lines:
+		# open the tower, loop counters are named by level so that their number is bounded
+		is_loop = []
+		for level in range(base, base + depth):
+			if len(out) >= lines:
+				break
+			is_loop.append(loops > 0 and rnd.random() < loops)
+			if is_loop[-1]:
+				emit(level, 'c%d = 0' % level)
+				emit(level, 'while c%d < %d' % (level, trips))
+			else:
+				emit(level, 'if %s < %s' % (var(), var()))
+			if mix is None:
+				emit(level + 1, '%s = %s + %s' % (var(), var(), var()))
+			else:
+				statement(level + 1, ['c%d' % l for l in range(base, level + 1) if is_loop[l - base]])
+		# close it, leaving statements at each level on the way back. The loops' increments
+		# are always emitted, even past the requested lines.
+		for level in range(base + len(is_loop) - 1, base - 1, -1):
+			if is_loop[level - base]:
+				emit(level + 1, 'c%d = c%d + 1' % (level, level))
+			if len(out) >= lines:
+				continue
+			if mix is None:
+				emit(level, '%s = %s - %s' % (var(), var(), var()))
+			else:
+				statement(level, ['c%d' % l for l in range(base, level) if is_loop[l - base]])
+
+	if not dead:
+		for i in range(1 if mix is None else min(vars, 8)):
+			emit(0, 'writeln v%d' % i)
+		for i in range(arrays):
+			emit(0, 'writeln a%d[%d]' % (i, rnd.randrange(array_size)))
+	return '\n'.join(out) + '\n'
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Generate a synthetic IPL program')
+	parser.add_argument('--lines', type=int, default=100000)
+	parser.add_argument('--depth', type=int, default=10)
+	parser.add_argument('--vars', type=int, default=100)
+	parser.add_argument('--arrays', type=int, default=0)
+	parser.add_argument('--array-size', type=int, default=64)
+	parser.add_argument('--loops', type=float, default=0.0, help='share of the blocks that are while loops')
+	parser.add_argument('--trips', type=int, default=10, help='iterations of each loop')
+	parser.add_argument('--mix', type=parse_mix, help='statement kinds and weights, eg add=2,mul=1,array=1 (of %s)' % ', '.join(KINDS))
+	parser.add_argument('--dead', action='store_true', help='never execute the generated code')
+	parser.add_argument('--seed', type=int, default=1)
+	args = parser.parse_args()
+
+	sys.stdout.write(generate(args.lines, args.depth, args.vars, args.dead, args.seed,
+		args.arrays, args.array_size, args.loops, args.trips, args.mix))
+
+
+if __name__ == '__main__':
+	main()
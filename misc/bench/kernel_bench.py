@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+#
+# Reduction kernel benchmark. For each of sum, dot, min, max, count generates a program that
+# runs the reduction loop REPEAT times over arrays of N elements, once in the form
+# that is compiled to a bulk instruction (see src/idiom.h) and once in an equivalent
+# form that is not (so each element is dispatched), and reports the time per element
+# of each given interpreter binary.
+#
+# usage: kernel_bench.py [--n N] [--repeat R] [--runs K] BINARY...
+
+import argparse
+import os
+import statistics
+import subprocess
+import tempfile
+import time
+
+# loop bodies, the counter is i, the arrays a and b
+KERNELS = {
+	'sum': (
+		['s = s + a[i]'],
+		['t = a[i]', 's = s + t'],
+	),
+	'dot': (
+		['t = a[i] * b[i]', 's = s + t'],
+		['u = b[i]', 't = a[i] * u', 's = s + t'],
+	),
+	'min': (
+		['if a[i] < s', '\ts = a[i]'],
+		['t = a[i]', 'if t < s', '\ts = t'],
+	),
+	'max': (
+		['if a[i] > s', '\ts = a[i]'],
+		['t = a[i]', 'if t > s', '\ts = t'],
+	),
+	'count': (
+		['if a[i] < 500', '\ts = s + 1'],
+		['t = a[i]', 'if t < 500', '\ts = s + 1'],
+	),
+}
+
+
+def program(body):
+	lines = [
+		'argument 1 n',
+		'argument 2 r',
+		'new a[n]',
+		'new b[n]',
+		'while i < n',
+		'\tx = i * 7919',
+		'\ta[i] = x % 1009',
+		'\tb[i] = i % 7',
+		'\ti = i + 1',
+		'while k < r',
+		'\ti = 0',
+		'\twhile i < n',
+	]
+	lines += ['\t\t' + line for line in body]
+	lines += [
+		'\t\ti = i + 1',
+		'\tk = k + 1',
+		'writeln s',
+	]
+	return '\n'.join(lines) + '\n'
+
+
+def run(binary, path, n, repeat):
+	start = time.perf_counter()
+	result = subprocess.run([binary, path, str(n), str(repeat)], check=True, stdout=subprocess.PIPE)
+	return time.perf_counter() - start, result.stdout
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Benchmark reduction kernels against dispatched loops')
+	parser.add_argument('--n', type=int, default=100000)
+	parser.add_argument('--repeat', type=int, default=200)
+	parser.add_argument('--runs', type=int, default=3)
+	parser.add_argument('binaries', nargs='+')
+	args = parser.parse_args()
+
+	elements = args.n * args.repeat
+	print('%-24s %6s %12s %12s %8s' % ('binary', 'kernel', 'bulk (ns)', 'loop (ns)', 'speedup'))
+	for name, (bulk, loop) in KERNELS.items():
+		files = []
+		for body in (bulk, loop):
+			with tempfile.NamedTemporaryFile('w', suffix='.ipl', delete=False) as f:
+				f.write(program(body))
+			files.append(f.name)
+		try:
+			for binary in args.binaries:
+				ns = []
+				outputs = set()
+				for path in files:
+					runs = [run(binary, path, args.n, args.repeat) for _ in range(args.runs)]
+					ns.append(min(t for t, _ in runs) / elements * 1e9)
+					outputs.update(out for _, out in runs)
+				if len(outputs) != 1:
+					print('%s: %s results differ' % (binary, name))
+				print('%-24s %6s %12.3f %12.3f %7.1fx' % (binary[-24:], name, ns[0], ns[1], ns[1] / ns[0]))
+		finally:
+			for path in files:
+				os.unlink(path)
+
+
+if __name__ == '__main__':
+	main()
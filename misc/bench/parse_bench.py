@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+#
+# Parse time benchmark. Generates large, deeply nested programs with iplgen.py
+# (in --dead mode, so nothing is executed) and reports the startup time of each
+# given interpreter binary.
+#
+# usage: parse_bench.py [--lines N ...] [--depth D ...] [--repeat R] BINARY...
+
+import argparse
+import os
+import statistics
+import subprocess
+import tempfile
+import time
+
+import iplgen
+
+
+def run(binary, path):
+	start = time.perf_counter()
+	subprocess.run([binary, path], check=True, stdout=subprocess.DEVNULL)
+	return time.perf_counter() - start
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Benchmark parse time of large programs')
+	parser.add_argument('--lines', type=int, nargs='+', default=[100000, 400000])
+	# the --dead branch adds a level, 999 is the deepest that ipli-fast accepts (PARSER_MAX_DEPTH)
+	parser.add_argument('--depth', type=int, nargs='+', default=[1, 10, 100, 999])
+	parser.add_argument('--repeat', type=int, default=5)
+	parser.add_argument('binaries', nargs='+')
+	args = parser.parse_args()
+
+	print('%-24s %8s %6s %10s %10s' % ('binary', 'lines', 'depth', 'min (s)', 'median (s)'))
+	for lines in args.lines:
+		for depth in args.depth:
+			with tempfile.NamedTemporaryFile('w', suffix='.ipl', delete=False) as f:
+				f.write(iplgen.generate(lines, depth, 100, True, 1))
+			try:
+				for binary in args.binaries:
+					times = [run(binary, f.name) for _ in range(args.repeat)]
+					print('%-24s %8d %6d %10.4f %10.4f' % (binary[-24:], lines, depth, min(times), statistics.median(times)))
+			finally:
+				os.unlink(f.name)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,263 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Υλοποίηση του ADT Map μέσω Hash Table με open addressing (linear probing)
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "ADTMap.h"
+
+
+// Κάθε θέση του hash table βρίσκεται σε μία από 3 καταστάσεις:
+// EMPTY: δεν έχει χρησιμοποιηθεί ποτέ (η αναζήτηση σταματάει εδώ)
+// OCCUPIED: περιέχει ένα ζεύγος key/value
+// DELETED: περιείχε ζεύγος που αφαιρέθηκε (η αναζήτηση συνεχίζει, αλλά μπορεί να ξαναχρησιμοποιηθεί)
+typedef enum {
+	EMPTY, OCCUPIED, DELETED
+} State;
+
+// Το αρχικό μέγεθος (πάντα δύναμη του 2, ώστε το modulo να γίνεται με μάσκα)
+#define MAP_MIN_CAPACITY 16
+
+// Μέγιστο ποσοστό κατειλημμένων (OCCUPIED ή DELETED) θέσεων πριν γίνει rehash
+#define MAX_LOAD_FACTOR 0.5
+
+struct map_node {
+	Pointer key;
+	Pointer value;
+	State state;
+};
+
+struct map {
+	MapNode array;				// Ο πίνακας με τις θέσεις του hash table
+	int capacity;				// Μέγεθος του πίνακα (δύναμη του 2)
+	int size;					// Αριθμός OCCUPIED θέσεων
+	int deleted;				// Αριθμός DELETED θέσεων
+	CompareFunc compare;
+	HashFunc hash_function;
+	DestroyFunc destroy_key, destroy_value;
+};
+
+
+Map map_create(CompareFunc compare, DestroyFunc destroy_key, DestroyFunc destroy_value) {
+	assert(compare != NULL);	// LCOV_EXCL_LINE
+
+	Map map = malloc(sizeof(*map));
+	map->capacity = MAP_MIN_CAPACITY;
+	map->array = calloc(map->capacity, sizeof(*map->array));	// όλες οι θέσεις EMPTY (0)
+	map->size = 0;
+	map->deleted = 0;
+	map->compare = compare;
+	map->hash_function = NULL;
+	map->destroy_key = destroy_key;
+	map->destroy_value = destroy_value;
+	return map;
+}
+
+int map_size(Map map) {
+	return map->size;
+}
+
+// Επιστρέφει τη θέση του key στον πίνακα, ή NULL αν δεν υπάρχει. Αν insert_pos != NULL,
+// αποθηκεύεται εκεί η θέση στην οποία θα έπρεπε να προστεθεί το key (η πρώτη DELETED
+// θέση που συναντήσαμε, αλλιώς η EMPTY στην οποία σταμάτησε η αναζήτηση).
+
+static MapNode find_node(Map map, Pointer key, MapNode* insert_pos) {
+	assert(map->hash_function != NULL);		// LCOV_EXCL_LINE (πρέπει να έχει κληθεί η map_set_hash_function)
+
+	uint mask = map->capacity - 1;
+	MapNode first_deleted = NULL;
+
+	// Το load factor είναι πάντα < 1, οπότε υπάρχει σίγουρα EMPTY θέση και το loop τερματίζει
+	for (uint pos = map->hash_function(key) & mask; ; pos = (pos + 1) & mask) {
+		MapNode node = &map->array[pos];
+
+		if (node->state == EMPTY) {
+			if (insert_pos != NULL)
+				*insert_pos = first_deleted != NULL ? first_deleted : node;
+			return NULL;
+
+		} else if (node->state == DELETED) {
+			if (first_deleted == NULL)
+				first_deleted = node;
+
+		} else if (node->key == key || map->compare(node->key, key) == 0) {
+			return node;
+		}
+	}
+}
+
+// Διπλασιάζει (αν χρειάζεται) το μέγεθος του πίνακα και ξαναπροσθέτει όλα τα στοιχεία,
+// αφαιρώντας ταυτόχρονα όλες τις DELETED θέσεις.
+
+static void rehash(Map map) {
+	MapNode old_array = map->array;
+	int old_capacity = map->capacity;
+
+	if (map->size >= map->capacity * MAX_LOAD_FACTOR / 2)
+		map->capacity *= 2;
+	map->array = calloc(map->capacity, sizeof(*map->array));
+	map->deleted = 0;
+
+	uint mask = map->capacity - 1;
+	for (int i = 0; i < old_capacity; i++) {
+		if (old_array[i].state != OCCUPIED)
+			continue;
+
+		uint pos = map->hash_function(old_array[i].key) & mask;
+		while (map->array[pos].state != EMPTY)
+			pos = (pos + 1) & mask;
+		map->array[pos] = old_array[i];
+	}
+
+	free(old_array);
+}
+
+Pointer map_find(Map map, Pointer key) {
+	MapNode node = find_node(map, key, NULL);
+	return node == NULL ? NULL : node->value;
+}
+
+void map_insert(Map map, Pointer key, Pointer value) {
+	MapNode insert_pos;
+	MapNode node = find_node(map, key, &insert_pos);
+	if (node != NULL) {
+		if (key != node->key && map->destroy_key != NULL)
+			map->destroy_key(node->key);
+
+		if (value != node->value && map->destroy_value != NULL)
+			map->destroy_value(node->value);
+
+		node->key = key;
+		node->value = value;
+		return;
+	}
+
+	if (insert_pos->state == DELETED)
+		map->deleted--;
+
+	insert_pos->key = key;
+	insert_pos->value = value;
+	insert_pos->state = OCCUPIED;
+	map->size++;
+
+	// Ο έλεγχος γίνεται μετά την προσθήκη, ώστε ο insert_pos να είναι ακόμα έγκυρος
+	if (map->size + map->deleted > map->capacity * MAX_LOAD_FACTOR)
+		rehash(map);
+}
+
+bool map_remove(Map map, Pointer key) {
+	MapNode node = find_node(map, key, NULL);
+	if (node == NULL)
+		return false;
+
+	if (map->destroy_key != NULL)
+		map->destroy_key(node->key);
+	if (map->destroy_value != NULL)
+		map->destroy_value(node->value);
+
+	node->state = DELETED;
+	map->size--;
+	map->deleted++;
+	return true;
+}
+
+DestroyFunc map_set_destroy_key(Map map, DestroyFunc destroy_key) {
+	DestroyFunc old = map->destroy_key;
+	map->destroy_key = destroy_key;
+	return old;
+}
+
+DestroyFunc map_set_destroy_value(Map map, DestroyFunc destroy_value) {
+	DestroyFunc old = map->destroy_value;
+	map->destroy_value = destroy_value;
+	return old;
+}
+
+void map_destroy(Map map) {
+	for (int i = 0; i < map->capacity; i++) {
+		if (map->array[i].state != OCCUPIED)
+			continue;
+		if (map->destroy_key != NULL)
+			map->destroy_key(map->array[i].key);
+		if (map->destroy_value != NULL)
+			map->destroy_value(map->array[i].value);
+	}
+
+	free(map->array);
+	free(map);
+}
+
+
+// Διάσχιση του map μέσω κόμβων ///////////////////////////////////////////////////
+//
+// Οι κόμβοι είναι θέσεις του πίνακα, οπότε δεν είναι έγκυροι μετά από map_insert.
+
+MapNode map_first(Map map) {
+	for (int i = 0; i < map->capacity; i++)
+		if (map->array[i].state == OCCUPIED)
+			return &map->array[i];
+
+	return MAP_EOF;
+}
+
+MapNode map_next(Map map, MapNode node) {
+	for (int i = node - map->array + 1; i < map->capacity; i++)
+		if (map->array[i].state == OCCUPIED)
+			return &map->array[i];
+
+	return MAP_EOF;
+}
+
+Pointer map_node_key(Map map, MapNode node) {
+	return node->key;
+}
+
+Pointer map_node_value(Map map, MapNode node) {
+	return node->value;
+}
+
+MapNode map_find_node(Map map, Pointer key) {
+	MapNode node = find_node(map, key, NULL);
+	return node == NULL ? MAP_EOF : node;
+}
+
+
+// Συναρτήσεις κατακερματισμού ////////////////////////////////////////////////////
+//
+// Οι θέσεις επιλέγονται με μάσκα (τα χαμηλά bits του hash), οπότε όλες οι συναρτήσεις
+// πρέπει να "ανακατεύουν" καλά τα bits του αποτελέσματος.
+
+// Τελικό ανακάτεμα των bits (από τον MurmurHash3)
+static uint mix(uint h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+uint hash_string(Pointer value) {
+	// djb2 hash function, απλή, γρήγορη, και σε γενικές γραμμές αποδοτική
+	uint hash = 5381;
+	for (char* s = value; *s != '\0'; s++)
+		hash = (hash << 5) + hash + *s;			// hash = (hash * 33) + *s. Το foo << 5 είναι γρηγορότερη εκδοχή του foo * 32.
+	return mix(hash);
+}
+
+uint hash_int(Pointer value) {
+	return mix(*(int*)value);
+}
+
+uint hash_pointer(Pointer value) {
+	uintptr_t p = (uintptr_t)value;
+	return mix((uint)p ^ (uint)((uint64_t)p >> 32));
+}
+
+void map_set_hash_function(Map map, HashFunc hash_func) {
+	map->hash_function = hash_func;
+}
@@ -0,0 +1,65 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct chunk {
+	struct chunk* prev;
+	size_t size, used;
+	max_align_t data[];			// max_align_t so that data is aligned for any type
+}* Chunk;
+
+struct arena {
+	Chunk last;
+};
+
+static Chunk create_chunk(size_t size, Chunk prev) {
+	Chunk chunk = calloc(1, sizeof(*chunk) + size);
+	chunk->prev = prev;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+Arena arena_create(void) {
+	Arena arena = malloc(sizeof(*arena));
+	arena->last = create_chunk(ARENA_CHUNK_SIZE, NULL);
+	return arena;
+}
+
+void* arena_alloc(Arena arena, size_t size) {
+	size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+
+	Chunk chunk = arena->last;
+	if(chunk->used + size > chunk->size) {
+		// large requests get a chunk of their own, placed _before_ the last one
+		// so that the remaining space of the latter is not wasted
+		if(size > ARENA_CHUNK_SIZE / 4) {
+			Chunk large = create_chunk(size, chunk->prev);
+			chunk->prev = large;
+			large->used = size;
+			return large->data;
+		}
+		chunk = arena->last = create_chunk(ARENA_CHUNK_SIZE, chunk);
+	}
+
+	void* p = (char*)chunk->data + chunk->used;
+	chunk->used += size;
+	return p;		// chunks are calloc'ed, so already zero
+}
+
+char* arena_strdup(Arena arena, const char* s) {
+	size_t size = strlen(s) + 1;
+	return memcpy(arena_alloc(arena, size), s, size);
+}
+
+void arena_destroy(Arena arena) {
+	for(Chunk chunk = arena->last, prev; chunk != NULL; chunk = prev) {
+		prev = chunk->prev;
+		free(chunk);
+	}
+	free(arena);
+}
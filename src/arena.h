@@ -0,0 +1,18 @@
+
+#pragma once
+
+#include <stddef.h>
+
+// Bump allocator for data with a common lifetime (eg all compile-time structures).
+// Individual allocations are never freed, the whole arena is released at once.
+
+typedef struct arena* Arena;
+
+Arena arena_create(void);
+
+// Returns size bytes of zero-initialized memory
+void* arena_alloc(Arena arena, size_t size);
+
+char* arena_strdup(Arena arena, const char* s);
+
+void arena_destroy(Arena arena);
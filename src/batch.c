@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "interpreter.h"
+
+typedef struct {
+	String line;		// the args_file line, split in place to args
+	String* args;
+	int arg_n;
+	char* out;			// the run's output
+	int out_n, out_size;
+	RunStatus status;
+	bool done;
+} Job;
+
+typedef struct batch* Batch;
+
+// aligned so that the locks of different workers are in different cache lines
+typedef struct worker {
+	pthread_mutex_t lock;
+	int begin, end;		// jobs [begin, end) are not taken yet
+	int id;
+	Job* job;			// the job that is currently running
+	Batch batch;
+	pthread_t thread;
+} __attribute__((aligned(64))) *Worker;
+
+struct batch {
+	Bytecode bytecode;
+	Job* jobs;
+	int job_n;
+	struct worker* workers;
+	int worker_n;
+	uint64_t seed;
+	pthread_mutex_t done_lock;		// protects Job.done
+	pthread_cond_t done_cond;
+};
+
+
+static void job_write(void* data, const char* buf, int len) {
+	Job* job = ((Worker)data)->job;
+	if(job->out_n + len > job->out_size) {
+		do
+			job->out_size = job->out_size ? 2 * job->out_size : OUTPUT_BUFFER_SIZE;
+		while(job->out_n + len > job->out_size);
+		job->out = realloc(job->out, job->out_size);
+	}
+	memcpy(job->out + job->out_n, buf, len);
+	job->out_n += len;
+}
+
+static bool job_read(void* data, int* value) {
+	return false;
+}
+
+// Takes the next job of the worker, or steals half of the remaining jobs of
+// another worker. Returns -1 when there are no jobs left anywhere.
+static int take_job(Worker worker) {
+	pthread_mutex_lock(&worker->lock);
+	int i = worker->begin < worker->end ? worker->begin++ : -1;
+	pthread_mutex_unlock(&worker->lock);
+	if(i != -1)
+		return i;
+
+	Batch batch = worker->batch;
+	for(int k = 1; k < batch->worker_n; k++) {
+		Worker victim = &batch->workers[(worker->id + k) % batch->worker_n];
+
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->end - victim->begin;
+		int begin = victim->end - (left + 1) / 2;		// the upper half, the victim keeps the lower
+		int end = victim->end;
+		victim->end = begin;
+		pthread_mutex_unlock(&victim->lock);
+
+		if(begin < end) {
+			// the first stolen job is executed now, the rest become ours. Only the owner
+			// adds jobs to a worker, so nothing could have been added to ours meanwhile.
+			pthread_mutex_lock(&worker->lock);
+			worker->begin = begin + 1;
+			worker->end = end;
+			pthread_mutex_unlock(&worker->lock);
+			return begin;
+		}
+	}
+	return -1;
+}
+
+static void* worker_main(void* arg) {
+	Worker worker = arg;
+	Batch batch = worker->batch;
+
+	IO io = { .write = job_write, .read = job_read, .data = worker };
+	Runtime runtime = interpreter_create_runtime(batch->bytecode, io, batch->seed + worker->id);
+
+	for(int i; (i = take_job(worker)) != -1; ) {
+		Job* job = worker->job = &batch->jobs[i];
+		interpreter_reset(runtime, job->arg_n, job->args);
+		job->status = interpreter_run(runtime);
+
+		pthread_mutex_lock(&batch->done_lock);
+		job->done = true;
+		pthread_cond_broadcast(&batch->done_cond);
+		pthread_mutex_unlock(&batch->done_lock);
+	}
+
+	interpreter_destroy_runtime(runtime);
+	return NULL;
+}
+
+// Reads args_file, one job per line
+static Vector read_jobs(String args_file) {
+	FILE* file = fopen(args_file, "r");
+	if(!file)
+		return NULL;
+
+	Vector jobs = vector_create(0, free);
+	char* line = NULL;
+	size_t line_size = 0;
+	while(getline(&line, &line_size, file) != -1) {
+		Job* job = calloc(1, sizeof(*job));
+		job->line = strdup(line);
+		job->args = malloc((strlen(line) / 2 + 1) * sizeof(*job->args));	// at most that many tokens
+
+		char* save;
+		for(String token = strtok_r(job->line, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save))
+			job->args[job->arg_n++] = token;
+
+		vector_insert_last(jobs, job);
+	}
+	free(line);
+	fclose(file);
+	return jobs;
+}
+
+int batch_run(Bytecode bytecode, String args_file, int thread_n) {
+	Vector job_vector = read_jobs(args_file);
+	if(job_vector == NULL)
+		return -1;
+
+	struct batch batch = {
+		.bytecode = bytecode,
+		.job_n = vector_size(job_vector),
+		.worker_n = thread_n > 0 ? thread_n : 1,
+		.seed = time(NULL),
+	};
+	pthread_mutex_init(&batch.done_lock, NULL);
+	pthread_cond_init(&batch.done_cond, NULL);
+
+	// contiguous array, so that workers can access all jobs without locking the vector
+	batch.jobs = malloc(batch.job_n * sizeof(*batch.jobs));
+	for(int i = 0; i < batch.job_n; i++)
+		batch.jobs[i] = *(Job*)vector_get_at(job_vector, i);
+	vector_destroy(job_vector);
+
+	// each worker initially gets an equal share of the jobs
+	batch.workers = aligned_alloc(64, batch.worker_n * sizeof(*batch.workers));
+	for(int w = 0; w < batch.worker_n; w++) {
+		Worker worker = &batch.workers[w];
+		pthread_mutex_init(&worker->lock, NULL);
+		worker->id = w;
+		worker->batch = &batch;
+		worker->begin = (long)batch.job_n * w / batch.worker_n;
+		worker->end = (long)batch.job_n * (w + 1) / batch.worker_n;
+	}
+	for(int w = 0; w < batch.worker_n; w++)		// after all are initialized, they steal from each other
+		pthread_create(&batch.workers[w].thread, NULL, worker_main, &batch.workers[w]);
+
+	// print the outputs in order, as soon as each one is ready
+	int failed_n = 0;
+	for(int i = 0; i < batch.job_n; i++) {
+		Job* job = &batch.jobs[i];
+		pthread_mutex_lock(&batch.done_lock);
+		while(!job->done)
+			pthread_cond_wait(&batch.done_cond, &batch.done_lock);
+		pthread_mutex_unlock(&batch.done_lock);
+
+		if(job->out_n > 0)
+			fwrite(job->out, 1, job->out_n, stdout);
+		if(job->status != RUN_OK) {
+			fflush(stdout);		// the job's output comes before its message
+			fprintf(stderr, "%s: line %d: %s\n", args_file, i + 1, interpreter_status_message(job->status));
+			failed_n++;
+		}
+		free(job->out);
+		free(job->args);
+		free(job->line);
+	}
+	fflush(stdout);
+
+	for(int w = 0; w < batch.worker_n; w++)
+		pthread_join(batch.workers[w].thread, NULL);
+	for(int w = 0; w < batch.worker_n; w++)
+		pthread_mutex_destroy(&batch.workers[w].lock);
+	pthread_mutex_destroy(&batch.done_lock);
+	pthread_cond_destroy(&batch.done_cond);
+	free(batch.workers);
+	free(batch.jobs);
+	return failed_n;
+}
@@ -0,0 +1,17 @@
+
+#pragma once
+
+#include "parser.h"
+
+// Batch mode: runs a compiled program once for each line of args_file (the
+// line's whitespace-separated tokens are the program's arguments).
+//
+// Runs are executed by thread_n workers, each with a private runtime and each run
+// with a private output buffer. Workers start with an equal share of the runs and
+// steal half of another worker's remaining share when they run out.
+// The outputs are written to stdout in the order of the lines. There is no input
+// in batch mode, a read statement stops the run. A run that stops early gets a
+// message on stderr, with its line, after its output.
+//
+// Returns the number of runs that stopped early, or -1 if args_file cannot be read.
+int batch_run(Bytecode bytecode, String args_file, int thread_n);
@@ -0,0 +1,203 @@
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "IPLC"
+#define CACHE_VERSION 5
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t opcode_n;			// the file is invalid if the Opcode enum changes
+	uint32_t var_n;
+	uint32_t array_n;
+	uint32_t args_array;
+	uint32_t word_n;
+	uint32_t loop_n;
+	uint32_t names_size;
+	uint32_t parallel;			// compiled with parallel loops
+	uint64_t source_hash;
+	// followed by Word values[var_n], Word words[word_n], int lines[word_n], LoopRange loops[loop_n],
+	// char names[names_size]
+} CacheHeader;
+
+// The operand words that follow each opcode, as generated by the parser: j a jump, v a variable,
+// a an array, x a variable or an array (an array if the bit of OP_ARRAY_OP's form says so)
+static const String operands[OP_COUNT] = {
+	[OP_WRITE] = "", [OP_WRITELN] = "", [OP_READ] = "",
+	[OP_LOAD1_V] = "v", [OP_LOAD1_A] = "va", [OP_LOAD2_V] = "v", [OP_LOAD2_A] = "va",
+	[OP_STORE_V] = "v", [OP_STORE_A] = "va",
+	[OP_ASSIGN_VV] = "vv", [OP_ASSIGN_VA] = "vav", [OP_ASSIGN_AV] = "vva", [OP_ASSIGN_AA] = "vava",
+	[OP_INC_V] = "v", [OP_INC_A] = "va", [OP_DEC_V] = "v", [OP_DEC_A] = "va",
+	[OP_JUMP] = "j", [OP_RAND] = "", [OP_NEW] = "va", [OP_FREE] = "va", [OP_SIZE] = "a",
+	[OP_HALT] = "", [OP_INTERRUPT] = "",
+	[OP_PARALLEL] = "jvvvv", [OP_REDUCE_ADD] = "v", [OP_REDUCE_MUL] = "v",
+	[OP_FILL] = "vvvva", [OP_COPY] = "vvvaa", [OP_IOTA] = "vvva",
+	[OP_COUNT_IF] = "vvvvvav", [OP_SEARCH] = "vvvvva",
+	[OP_SUM_V] = "vvvvvav", [OP_SUM_A] = "vvvvvava", [OP_DOT_V] = "vvvvvavvav", [OP_DOT_A] = "vvvvvavvava",
+	[OP_MIN] = "vvvvvav", [OP_MAX] = "vvvvvav",
+	[OP_PREFETCH] = "vva",
+	[OP_LOAD_BYTE] = "vav", [OP_STORE_BYTE] = "vva", [OP_LOAD_SHORT] = "vav", [OP_STORE_SHORT] = "vva",
+	[OP_LOAD_BIT] = "vav", [OP_STORE_BIT] = "vva",
+	[OP_READ_ARRAY] = "va", [OP_WRITE_ARRAY] = "va", [OP_WRITELN_ARRAY] = "va",
+	[OP_ARRAY_OP] = "vxxa",
+	[OP_ADD_VVV] = "vvv", [OP_ADD_VVA] = "vvav", [OP_ADD_VAA] = "vavav",
+	[OP_ADD_AVV] = "vvva", [OP_ADD_AVA] = "vvava", [OP_ADD_AAA] = "vavava",
+	[OP_SUB_VVV] = "vvv", [OP_SUB_VVA] = "vvav", [OP_SUB_VAA] = "vavav",
+	[OP_SUB_AVV] = "vvva", [OP_SUB_AVA] = "vvava", [OP_SUB_AAA] = "vavava",
+	[OP_MUL] = "", [OP_DIV] = "", [OP_MOD] = "",
+	[OP_EQ_VV] = "jvv", [OP_EQ_VA] = "jvva", [OP_EQ_AA] = "jvava",
+	[OP_NEQ_VV] = "jvv", [OP_NEQ_VA] = "jvva", [OP_NEQ_AA] = "jvava",
+	[OP_LE_VV] = "jvv", [OP_LE_VA] = "jvva", [OP_LE_AV] = "jvav", [OP_LE_AA] = "jvava",
+	[OP_LT_VV] = "jvv", [OP_LT_VA] = "jvva", [OP_LT_AV] = "jvav", [OP_LT_AA] = "jvava",
+};
+
+// Checks that the words are instructions followed by their operands, within the runtime's
+// memory, that the jumps land on instructions and that the last instruction halts. A
+// corrupted file could otherwise make the thread point anywhere.
+static bool valid_words(Word* values, Word* words, CacheHeader* header) {
+	bool* starts = calloc(header->word_n + 1, sizeof(*starts));		// of instructions
+	int last = -1;
+	bool ok = true;
+	for(int64_t i = 0; ok && i < header->word_n; ) {
+		int opcode = WORD_VALUE(words[i]);
+		if(WORD_TAG(words[i]) != TAG_OPCODE || opcode < 0 || opcode >= OP_COUNT || operands[opcode] == NULL) {
+			ok = false;
+			break;
+		}
+		starts[last = i] = true;
+
+		String operand = operands[opcode];
+		int form = 0;
+		if(opcode == OP_ARRAY_OP && i + 1 < header->word_n && WORD_TAG(words[i + 1]) == TAG_VAR &&
+		   WORD_VALUE(words[i + 1]) >= 0 && WORD_VALUE(words[i + 1]) < header->var_n)
+			form = values[WORD_VALUE(words[i + 1])];		// a constant, so never changed
+		int x_n = 0;		// x operands seen
+
+		for(i++; ok && *operand != '\0'; i++, operand++) {
+			if(i >= header->word_n) {
+				ok = false;
+				break;
+			}
+			int value = WORD_VALUE(words[i]);
+			int tag = WORD_TAG(words[i]);
+			char expected = *operand == 'x' ? ((form >> x_n++) & 1 ? 'a' : 'v') : *operand;
+			ok = expected == 'j' ? tag == TAG_JUMP && i + value >= 0 && i + value < header->word_n :
+				 expected == 'v' ? tag == TAG_VAR && value >= 0 && value < header->var_n :
+				 tag == TAG_ARRAY && value >= 0 && value < header->array_n;
+		}
+	}
+	ok = ok && last != -1 && WORD_VALUE(words[last]) == OP_HALT;
+
+	// jumps are relative to their own word
+	for(int64_t i = 0; ok && i < header->word_n; i++)
+		if(WORD_TAG(words[i]) == TAG_JUMP && !starts[i + WORD_VALUE(words[i])])
+			ok = false;
+
+	free(starts);
+	return ok;
+}
+
+
+void cache_write(String filename, Bytecode bytecode) {
+	CacheHeader header = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.opcode_n = OP_COUNT,
+		.var_n = bytecode->var_n,
+		.array_n = bytecode->array_n,
+		.args_array = bytecode->args_array,
+		.word_n = bytecode->word_n,
+		.loop_n = bytecode->loop_n,
+		.names_size = bytecode->names_size,
+		.parallel = bytecode->parallel,
+		.source_hash = bytecode->source_hash,
+	};
+
+	// write to a temporary file and rename, so that a concurrent load never sees a partial file
+	char tmp_file[strlen(filename) + 16];
+	sprintf(tmp_file, "%s.%d.tmp", filename, (int)getpid());
+
+	FILE* file = fopen(tmp_file, "wb");
+	bool ok = file != NULL &&
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(bytecode->values, sizeof(Word), header.var_n, file) == header.var_n &&
+		fwrite(bytecode->words, sizeof(Word), header.word_n, file) == header.word_n &&
+		fwrite(bytecode->lines, sizeof(int), header.word_n, file) == header.word_n &&
+		fwrite(bytecode->loops, sizeof(LoopRange), header.loop_n, file) == header.loop_n &&
+		fwrite(bytecode->names, 1, header.names_size, file) == header.names_size;
+	if(file != NULL && fclose(file) != 0)
+		ok = false;
+	if(!ok || rename(tmp_file, filename) != 0) {
+		fprintf(stderr, "cannot write cache file %s\n", filename);
+		unlink(tmp_file);
+	}
+}
+
+Bytecode cache_load(String filename, uint64_t source_hash) {
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1)
+		return NULL;
+
+	struct stat st;
+	CacheHeader* header = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size >= sizeof(CacheHeader))
+		header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(header == MAP_FAILED)
+		return NULL;
+
+	if(memcmp(header->magic, CACHE_MAGIC, 4) != 0 ||
+	   header->version != CACHE_VERSION ||
+	   header->opcode_n != OP_COUNT ||
+	   header->source_hash != source_hash ||
+	   header->args_array >= header->array_n ||
+	   st.st_size != sizeof(CacheHeader) + (header->var_n + (uint64_t)header->word_n) * sizeof(Word) +
+			header->word_n * (uint64_t)sizeof(int) + header->loop_n * (uint64_t)sizeof(LoopRange) + header->names_size) {
+		munmap(header, st.st_size);
+		return NULL;
+	}
+
+	Word* words = (Word*)(header + 1) + header->var_n;
+	if(!valid_words((Word*)(header + 1), words, header)) {
+		munmap(header, st.st_size);
+		return NULL;
+	}
+	int* lines = (int*)(words + header->word_n);
+	LoopRange* loops = (LoopRange*)(lines + header->word_n);
+	for(uint32_t i = 0; i < header->loop_n; i++) {
+		if(loops[i].start < 0 || loops[i].start > loops[i].end || loops[i].end > header->word_n) {
+			munmap(header, st.st_size);
+			return NULL;
+		}
+	}
+
+	Bytecode bytecode = calloc(1, sizeof(*bytecode));
+	bytecode->var_n = header->var_n;
+	bytecode->array_n = header->array_n;
+	bytecode->args_array = header->args_array;
+	bytecode->word_n = header->word_n;
+	bytecode->source_hash = header->source_hash;
+	bytecode->parallel = header->parallel != 0;
+	bytecode->values = (Word*)(header + 1);
+	bytecode->words = bytecode->values + header->var_n;
+	bytecode->lines = lines;
+	bytecode->loops = loops;
+	bytecode->loop_n = header->loop_n;
+	bytecode->names = (char*)(loops + header->loop_n);
+	bytecode->names_size = header->names_size;
+	bytecode->mapping = header;
+	bytecode->mapping_size = st.st_size;
+	if(!parser_index_names(bytecode)) {
+		parser_destroy_bytecode(bytecode);
+		return NULL;
+	}
+	return bytecode;
+}
@@ -0,0 +1,19 @@
+
+#pragma once
+
+#include "parser.h"
+
+// Precompiled bytecode cache (.iplc files).
+//
+// The file contains a Bytecode as is: a header, the initial values of the
+// variables frame, the thread words and the debug info (source lines, loops and
+// names). Since Bytecode is position-independent, loading is just an mmap, the
+// relocation happens in interpreter_reset.
+//
+// The file is keyed by a hash of the source, stale caches are ignored.
+
+void cache_write(String filename, Bytecode bytecode);
+
+// Returns the bytecode stored in filename, or NULL if the file does not exist,
+// is invalid or was created from a different source.
+Bytecode cache_load(String filename, uint64_t source_hash);
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "counters.h"
+
+enum { EV_CYCLES, EV_INSTRUCTIONS, EV_BRANCH_MISSES, EV_L1D_MISSES, EV_LLC_MISSES, EVENT_N };
+
+static const String event_names[EVENT_N] = { "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses" };
+
+typedef struct {
+	uint64_t values[EVENT_N];
+	uint64_t ticks;
+	uint64_t entries;
+} RegionCounts;
+
+struct counters {
+	Bytecode bytecode;
+	int nest_n;
+	int* nests;				// index in bytecode->loops of each outermost loop
+	int* region;			// of each thread position, a nest or nest_n for the code outside of loops
+	bool* boundary;
+	RegionCounts* counts;	// nest_n + 1
+	int current;
+
+	int group;				// fd of the group leader (cycles), -1 if counters are unavailable
+	String error;			// why they are
+	int member_n;
+	int members[EVENT_N];	// event of each group member, in the order of the group's read
+	int fds[EVENT_N];		// of each member
+	bool present[EVENT_N];
+	uint64_t last[EVENT_N];	// values at the last region change
+	uint64_t last_ticks;
+};
+
+static uint64_t ticks(void) {
+	#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+	#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+	#endif
+}
+
+#ifdef __linux__
+static int open_event(int event, int group) {
+	static const struct { uint32_t type; uint64_t config; } configs[EVENT_N] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	};
+	struct perf_event_attr attr = {
+		.size = sizeof(attr),
+		.type = configs[event].type,
+		.config = configs[event].config,
+		.read_format = PERF_FORMAT_GROUP,
+		.exclude_kernel = 1,		// allowed with perf_event_paranoid <= 2
+		.exclude_hv = 1,
+	};
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+static void open_counters(Counters counters) {
+	counters->group = -1;
+	#ifdef __linux__
+	counters->group = open_event(EV_CYCLES, -1);
+	if(counters->group == -1) {
+		counters->error = strerror(errno);
+		return;
+	}
+	counters->fds[counters->member_n] = counters->group;
+	counters->members[counters->member_n++] = EV_CYCLES;
+	counters->present[EV_CYCLES] = true;
+	for(int event = EV_CYCLES + 1; event < EVENT_N; event++) {
+		int fd = open_event(event, counters->group);
+		if(fd != -1) {
+			counters->fds[counters->member_n] = fd;
+			counters->members[counters->member_n++] = event;
+			counters->present[event] = true;
+		}
+	}
+	#else
+	counters->error = "not supported";
+	#endif
+}
+
+static void read_counters(Counters counters, uint64_t values[EVENT_N], uint64_t* now) {
+	*now = ticks();
+	uint64_t buf[1 + EVENT_N];		// PERF_FORMAT_GROUP: the number of members, then their values
+	if(counters->group != -1 && read(counters->group, buf, sizeof(buf)) > 0)
+		for(int i = 0; i < buf[0] && i < counters->member_n; i++)
+			values[counters->members[i]] = buf[1 + i];
+}
+
+Counters counters_create(Bytecode bytecode) {
+	Counters counters = calloc(1, sizeof(*counters));
+	counters->bytecode = bytecode;
+
+	// loops are sorted outer first, a loop that starts after the current nest's end is a new nest
+	counters->nests = malloc(bytecode->loop_n * sizeof(*counters->nests));
+	int nest_end = 0;
+	for(int i = 0; i < bytecode->loop_n; i++) {
+		if(bytecode->loops[i].start >= nest_end) {
+			counters->nests[counters->nest_n++] = i;
+			nest_end = bytecode->loops[i].end;
+		}
+	}
+
+	counters->region = malloc(bytecode->word_n * sizeof(*counters->region));
+	for(int i = 0; i < bytecode->word_n; i++)
+		counters->region[i] = counters->nest_n;
+	for(int n = 0; n < counters->nest_n; n++)
+		for(int i = bytecode->loops[counters->nests[n]].start; i < bytecode->loops[counters->nests[n]].end; i++)
+			counters->region[i] = n;
+
+	// regions are entered by falling through from the previous instruction, or by a jump
+	counters->boundary = calloc(bytecode->word_n, sizeof(*counters->boundary));
+	int last_opcode = -1;
+	for(int i = 0; i < bytecode->word_n; i++) {
+		Word word = bytecode->words[i];
+		if(WORD_TAG(word) == TAG_OPCODE) {
+			if(last_opcode != -1 && counters->region[last_opcode] != counters->region[i])
+				counters->boundary[i] = true;
+			last_opcode = i;
+		} else if(WORD_TAG(word) == TAG_JUMP) {
+			int target = i + WORD_VALUE(word);
+			if(counters->region[target] != counters->region[i])
+				counters->boundary[target] = true;
+		}
+	}
+
+	counters->counts = calloc(counters->nest_n + 1, sizeof(*counters->counts));
+	counters->current = counters->nest_n;
+	open_counters(counters);
+	return counters;
+}
+
+bool counters_boundary(Counters counters, int pos) {
+	return counters->boundary[pos];
+}
+
+void counters_start(Counters counters, int pos) {
+	counters->current = counters->region[pos];
+	counters->counts[counters->current].entries++;
+	read_counters(counters, counters->last, &counters->last_ticks);
+}
+
+// adds the counts since the last change to the current region
+static void add_counts(Counters counters) {
+	uint64_t values[EVENT_N] = { 0 };
+	uint64_t now;
+	read_counters(counters, values, &now);
+
+	RegionCounts* counts = &counters->counts[counters->current];
+	for(int i = 0; i < EVENT_N; i++)
+		counts->values[i] += values[i] - counters->last[i];
+	counts->ticks += now - counters->last_ticks;
+	memcpy(counters->last, values, sizeof(values));
+	counters->last_ticks = now;
+}
+
+void counters_enter(Counters counters, int pos) {
+	int region = counters->region[pos];
+	if(region == counters->current)
+		return;		// eg a jump to the start of the same nest
+	add_counts(counters);
+	counters->current = region;
+	counters->counts[region].entries++;
+}
+
+void counters_finish(Counters counters) {
+	add_counts(counters);
+}
+
+// misses per 1000 instructions, or "-" if the event is not available
+static void print_mpki(Counters counters, RegionCounts* counts, int event, FILE* out) {
+	if(counters->present[event] && counts->values[EV_INSTRUCTIONS] > 0)
+		fprintf(out, " %9.2f", 1000.0 * counts->values[event] / counts->values[EV_INSTRUCTIONS]);
+	else
+		fprintf(out, " %9s", "-");
+}
+
+void counters_report(Counters counters, FILE* out) {
+	Bytecode bytecode = counters->bytecode;
+	uint64_t total_ticks = 0;
+	for(int r = 0; r <= counters->nest_n; r++)
+		total_ticks += counters->counts[r].ticks;
+
+	if(counters->group != -1) {
+		fprintf(out, "counters:");
+		for(int i = 0; i < counters->member_n; i++)
+			fprintf(out, " %s", event_names[counters->members[i]]);
+		fprintf(out, "\n%-16s %9s %7s %14s %14s %6s %9s %9s %9s\n",
+			"region", "entries", "time", "cycles", "instructions", "IPC", "br-MPKI", "L1d-MPKI", "LLC-MPKI");
+	} else {
+		fprintf(out, "counters unavailable (perf_event_open: %s), time stamp counter only\n", counters->error);
+		fprintf(out, "%-16s %9s %7s %16s\n", "region", "entries", "time", "ticks");
+	}
+
+	for(int r = 0; r <= counters->nest_n; r++) {
+		RegionCounts* counts = &counters->counts[r];
+		char name[32] = "outside loops";
+		if(r < counters->nest_n) {
+			// the nest's lines, from the while to the last line of its body
+			LoopRange loop = bytecode->loops[counters->nests[r]];
+			int last_line = loop.line;
+			for(int i = loop.start; i < loop.end; i++)
+				if(bytecode->lines[i] > last_line)
+					last_line = bytecode->lines[i];
+			snprintf(name, sizeof(name), "while %d-%d", loop.line, last_line);
+		}
+
+		fprintf(out, "%-16s %9" PRIu64 " %6.2f%%", name, counts->entries, total_ticks > 0 ? 100.0 * counts->ticks / total_ticks : 0);
+		if(counters->group == -1) {
+			fprintf(out, " %16" PRIu64 "\n", counts->ticks);
+			continue;
+		}
+		fprintf(out, " %14" PRIu64, counts->values[EV_CYCLES]);
+		if(counters->present[EV_INSTRUCTIONS]) {
+			fprintf(out, " %14" PRIu64, counts->values[EV_INSTRUCTIONS]);
+			if(counts->values[EV_CYCLES] > 0)
+				fprintf(out, " %6.2f", (double)counts->values[EV_INSTRUCTIONS] / counts->values[EV_CYCLES]);
+			else
+				fprintf(out, " %6s", "-");
+		} else {
+			fprintf(out, " %14s %6s", "-", "-");
+		}
+		print_mpki(counters, counts, EV_BRANCH_MISSES, out);
+		print_mpki(counters, counts, EV_L1D_MISSES, out);
+		print_mpki(counters, counts, EV_LLC_MISSES, out);
+		fprintf(out, "\n");
+	}
+}
+
+bool counters_total(Counters counters, String event, uint64_t* value) {
+	for(int i = 0; i < EVENT_N; i++) {
+		if(strcmp(event_names[i], event) != 0 || !counters->present[i])
+			continue;
+		*value = 0;
+		for(int r = 0; r <= counters->nest_n; r++)
+			*value += counters->counts[r].values[i];
+		return true;
+	}
+	return false;
+}
+
+void counters_destroy(Counters counters) {
+	for(int i = 0; i < counters->member_n; i++)
+		close(counters->fds[i]);
+	free(counters->nests);
+	free(counters->region);
+	free(counters->boundary);
+	free(counters->counts);
+	free(counters);
+}
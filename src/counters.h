@@ -0,0 +1,50 @@
+
+#pragma once
+
+#include <stdio.h>
+
+#include "parser.h"
+
+// Hardware performance counters per loop nest. The run is split in regions, one for each
+// outermost while loop (with the loops it contains) and one for the code outside of all
+// loops. The counters are read with perf_event_open (cycles, instructions, branch misses,
+// L1 data and last level cache read misses, of the calling thread, user space only)
+// whenever the run moves to another region, and the difference is added to the region
+// it left. So a nest's IPC and misses per 1000 instructions (MPKI) tell whether it is
+// dispatch bound (branch misses) or memory bound (cache misses).
+//
+// Only the instructions where a region can be entered (from another region, by falling
+// through or by a jump) are instrumented, they notify counters_enter before executing.
+// Nests are entered and left rarely compared to the instructions they execute, so the
+// cost of the reads (a syscall each) is small. The worker threads of parallel loops are
+// not counted, except for the share of the calling thread.
+//
+// Counters may be unavailable (eg in containers and VMs without a PMU, or with a strict
+// perf_event_paranoid). Then only the time stamp counter (rdtsc) is read, and the report
+// has the ticks of each region. Single events that are not supported are left out.
+
+typedef struct counters* Counters;
+
+// Creates the counters of bytecode's loop nests
+Counters counters_create(Bytecode bytecode);
+
+// Returns true if pos is the opcode of an instruction where a region can be entered
+bool counters_boundary(Counters counters, int pos);
+
+// Called when a run starts at thread position pos
+void counters_start(Counters counters, int pos);
+
+// Called before executing the instruction at boundary pos
+void counters_enter(Counters counters, int pos);
+
+// Called when the run ends, the counts since the last region change go to the current one
+void counters_finish(Counters counters);
+
+// Prints each region with its counts, IPC and MPKI (or ticks only)
+void counters_report(Counters counters, FILE* out);
+
+// Stores in value the count of event (eg "cycles", "branch-misses") over all regions,
+// returns false if the event is not available
+bool counters_total(Counters counters, String event, uint64_t* value);
+
+void counters_destroy(Counters counters);
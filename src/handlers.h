@@ -0,0 +1,612 @@
+
+// The handlers of all instructions, included by interpreter.c once for its dispatch backend
+// (see there). Each is written with the backend's macros:
+//
+//   HANDLER(op)   starts the handler of op, with ip (pointing to the word after the opcode),
+//                 reg1, reg2, runtime and status in scope
+//   NEXT          executes the instruction at ip, with ip moved past its opcode
+//   DISPATCH(e)   executes the thread entry e (eg of runtime->profile_targets), ip unchanged
+//   PUBLISH_IP()  points interpreter_ip to this run's ip, if the backend can
+//
+// A handler ends with NEXT, DISPATCH or by returning NULL (with *status set) to stop the run.
+// Handlers should not take the address of their locals, so that the tail-call backend can
+// still turn NEXT into a jump.
+
+HANDLER(OP_LOAD1_V) {
+	reg1 = *(int*)*ip++;
+	NEXT
+}
+
+HANDLER(OP_LOAD2_V) {
+	reg2 = *(int*)*ip++;
+	NEXT
+}
+
+HANDLER(OP_LOAD1_A) {
+	reg1 = ((Array)*(ip+1))[*(int*)*ip];
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_LOAD2_A) {
+	reg2 = ((Array)*(ip+1))[*(int*)*ip];
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_STORE_V) {
+	*(int*)*ip++ = reg1;
+	NEXT
+}
+
+HANDLER(OP_STORE_A) {
+	((Array)*(ip+1))[*(int*)*ip] = reg1;
+	ip += 2;
+	NEXT
+}
+
+// assign ///////////////////////
+HANDLER(OP_ASSIGN_VV) {
+	*(int*)*(ip+1) = *(int*)*ip;
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_ASSIGN_VA) {
+	*(int*)*(ip+2) = ((Array)*(ip+1))[*(int*)*ip];
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_ASSIGN_AV) {
+	((Array)*(ip+2))[*(int*)*(ip+1)] = *(int*)*ip;
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_ASSIGN_AA) {
+	((Array)*(ip+3))[*(int*)*(ip+2)] = ((Array)*(ip+1))[*(int*)*ip];
+	ip += 4;
+	NEXT
+}
+
+
+HANDLER(OP_INC_V) {
+	++ *(int*)(*ip++);
+	NEXT
+}
+
+HANDLER(OP_INC_A) {
+	++ ((Array)*(ip+1))[*(int*)*ip];
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_DEC_V) {
+	-- *(int*)(*ip++);
+	NEXT
+}
+
+HANDLER(OP_DEC_A) {
+	-- ((Array)*(ip+1))[*(int*)*ip];
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_JUMP) {
+	ip = *ip;
+	NEXT
+}
+
+// ADD /////////////////////////////
+
+HANDLER(OP_ADD_VVV) {
+	*(int*)*(ip+2) = *(int*)*ip + *(int*)*(ip+1);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_ADD_VVA) {
+	*(int*)*(ip+3) = *(int*)*ip + ((Array)*(ip+2))[*(int*)*(ip+1)];
+	ip += 4;
+	NEXT
+}
+
+HANDLER(OP_ADD_VAA) {
+	*(int*)*(ip+4) = ((Array)*(ip+1))[*(int*)*ip] + ((Array)*(ip+3))[*(int*)*(ip+2)];
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_ADD_AVV) {
+	((Array)*(ip+3))[*(int*)*(ip+2)] = *(int*)*ip + *(int*)*(ip+1);
+	ip += 4;
+	NEXT
+}
+
+HANDLER(OP_ADD_AVA) {
+	((Array)*(ip+4))[*(int*)*(ip+3)] = *(int*)*ip + ((Array)*(ip+2))[*(int*)*(ip+1)];
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_ADD_AAA) {
+	((Array)*(ip+5))[*(int*)*(ip+4)] = ((Array)*(ip+1))[*(int*)*ip] + ((Array)*(ip+3))[*(int*)*(ip+2)];
+	ip += 6;
+	NEXT
+}
+
+// SUB /////////////////////////////
+
+HANDLER(OP_SUB_VVV) {
+	*(int*)*(ip+2) = *(int*)*ip - *(int*)*(ip+1);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_SUB_VVA) {
+	*(int*)*(ip+3) = *(int*)*ip - ((Array)*(ip+2))[*(int*)*(ip+1)];
+	ip += 4;
+	NEXT
+}
+
+HANDLER(OP_SUB_VAA) {
+	*(int*)*(ip+4) = ((Array)*(ip+1))[*(int*)*ip] - ((Array)*(ip+3))[*(int*)*(ip+2)];
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_SUB_AVV) {
+	((Array)*(ip+3))[*(int*)*(ip+2)] = *(int*)*ip - *(int*)*(ip+1);
+	ip += 4;
+	NEXT
+}
+
+HANDLER(OP_SUB_AVA) {
+	((Array)*(ip+4))[*(int*)*(ip+3)] = *(int*)*ip - ((Array)*(ip+2))[*(int*)*(ip+1)];
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_SUB_AAA) {
+	((Array)*(ip+5))[*(int*)*(ip+4)] = ((Array)*(ip+1))[*(int*)*ip] - ((Array)*(ip+3))[*(int*)*(ip+2)];
+	ip += 6;
+	NEXT
+}
+
+/////////////////////
+
+HANDLER(OP_EQ_VV) {
+	ip = *(int*)*(ip+1) == *(int*)*(ip+2)
+		? ip+3 : *ip;
+	NEXT
+}
+
+HANDLER(OP_EQ_VA) {
+	ip = *(int*)*(ip+1) == ((Array)*(ip+3))[*(int*)*(ip+2)]
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_EQ_AA) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] == ((Array)*(ip+4))[*(int*)*(ip+3)]
+		? ip+5 : *ip;
+	NEXT
+}
+
+HANDLER(OP_NEQ_VV) {
+	ip = *(int*)*(ip+1) != *(int*)*(ip+2)
+		? ip+3 : *ip;
+	NEXT
+}
+
+HANDLER(OP_NEQ_VA) {
+	ip = *(int*)*(ip+1) != ((Array)*(ip+3))[*(int*)*(ip+2)]
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_NEQ_AA) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] != ((Array)*(ip+4))[*(int*)*(ip+3)]
+		? ip+5 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LE_VV) {
+	ip = *(int*)*(ip+1) <= *(int*)*(ip+2)
+		? ip+3 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LE_VA) {
+	ip = *(int*)*(ip+1) <= ((Array)*(ip+3))[*(int*)*(ip+2)]
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LE_AV) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] <= *(int*)*(ip+3)
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LE_AA) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] <= ((Array)*(ip+4))[*(int*)*(ip+3)]
+		? ip+5 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LT_VV) {
+	ip = *(int*)*(ip+1) < *(int*)*(ip+2)
+		? ip+3 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LT_VA) {
+	ip = *(int*)*(ip+1) < ((Array)*(ip+3))[*(int*)*(ip+2)]
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LT_AV) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] < *(int*)*(ip+3)
+		? ip+4 : *ip;
+	NEXT
+}
+
+HANDLER(OP_LT_AA) {
+	ip = ((Array)*(ip+2))[*(int*)*(ip+1)] < ((Array)*(ip+4))[*(int*)*(ip+3)]
+		? ip+5 : *ip;
+	NEXT
+}
+
+
+//////////////////////////////
+
+HANDLER(OP_MUL) {
+	reg1 = reg1 * reg2;
+	NEXT
+}
+
+// a division that would trap (SIGFPE) stops the run instead
+#define CHECK_DIVISION																\
+	if(reg2 == 0 || (reg1 == INT_MIN && reg2 == -1)) {								\
+		flush_output(runtime);														\
+		*status = RUN_DIVISION_ERROR;												\
+		return NULL;																\
+	}
+
+HANDLER(OP_DIV) {
+	CHECK_DIVISION
+	reg1 = reg1 / reg2;
+	NEXT
+}
+
+HANDLER(OP_MOD) {
+	CHECK_DIVISION
+	reg1 = reg1 % reg2;
+	NEXT
+}
+
+HANDLER(OP_NEW) {
+	int bits = *(int*)*ip;
+	int* old_array = *(ip+1);
+	free_ints(old_array - 1, bits, runtime);	// we always have a placeholder memory reserved
+	int int_n = array_ints(reg1, bits);
+	if(runtime->memory_limit && runtime->memory_used + (size_t)int_n * sizeof(int) > runtime->memory_limit) {
+		flush_output(runtime);
+		*status = RUN_OUT_OF_MEMORY;
+		return NULL;
+	}
+	int* new_array = alloc_ints(int_n, runtime);
+	new_array[0] = reg1;				// we store the size in the first element
+	new_array++;						// and point to the second element
+	patch_thread(runtime, old_array, new_array);
+	runtime->new_n++;
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_FREE) {
+	int* old_array = *(ip+1);
+	free_ints(old_array - 1, *(int*)*ip, runtime);
+	int* new_array = alloc_ints(1, runtime); // we create a placeholder empty array
+	new_array[0] = 0;					// we store the size in the first element
+	new_array++;						// and point to the second element
+	patch_thread(runtime, old_array, new_array);
+	runtime->free_n++;
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_SIZE) {
+	reg1 = ((Array)*ip++)[-1];
+	NEXT
+}
+
+HANDLER(OP_WRITE) {
+	write_int(runtime, reg1, ' ');
+	NEXT
+}
+
+HANDLER(OP_WRITELN) {
+	write_int(runtime, reg1, '\n');
+	NEXT
+}
+
+HANDLER(OP_READ) {
+	flush_output(runtime);		// eg prompts should appear before blocking for input
+	long long value = read_value(runtime);
+	if(value == NO_INPUT) {
+		*status = RUN_NO_INPUT;
+		return NULL;
+	}
+	reg1 = value;
+	NEXT
+}
+
+HANDLER(OP_RAND) {
+	reg1 = next_rand(runtime);
+	NEXT
+}
+
+HANDLER(OP_HALT) {
+	flush_output(runtime);
+	*status = RUN_OK;
+	return NULL;
+}
+
+HANDLER(OP_INTERRUPT) {
+	flush_output(runtime);
+	*status = RUN_INTERRUPTED;
+	return NULL;
+}
+
+// When profiling, all instructions of the thread point here (so the normal dispatch
+// has no profiling cost), ip-1 is the position of the instruction.
+HANDLER(OP_PROFILED) {
+	int pos = ip - 1 - runtime->thread;
+	runtime->exec_count[pos]++;
+	DISPATCH(runtime->profile_targets[pos])
+}
+
+// Instructions where a loop nest of runtime->counters can be entered point here
+HANDLER(OP_COUNTERS) {
+	int pos = ip - 1 - runtime->thread;
+	if(runtime->exec_count != NULL)
+		runtime->exec_count[pos]++;
+	counters_enter(runtime->counters, pos);
+	DISPATCH(runtime->profile_targets[pos])
+}
+
+// the loop's own code is executed by the threads, or here sequentially
+HANDLER(OP_PARALLEL) {
+	if(runtime->parallel_n > 1 && run_parallel(runtime, ip, status)) {
+		if(*status != RUN_OK)
+			return NULL;		// a worker stopped with an error
+		PUBLISH_IP();		// worker 0 ran in this thread
+		ip = *ip;
+	} else {
+		*(int*)*(ip+3) = *(int*)*(ip+2);
+		ip += 5;
+	}
+	NEXT
+}
+
+// the reductions are combined by run_parallel, here they are skipped
+HANDLER(OP_REDUCE_ADD) {
+	ip++;
+	NEXT
+}
+
+HANDLER(OP_REDUCE_MUL) {
+	ip++;
+	NEXT
+}
+
+// loop idioms, for counter from its value up to the bound (+1 for <=), where it ends
+HANDLER(OP_FILL) {
+	int lo = *(int*)*ip;
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);
+	if(lo < hi) {
+		kernel_fill((Array)*(ip+4) + lo, hi - lo, *(int*)*(ip+3));
+		*(int*)*ip = hi;
+	}
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_COPY) {
+	int lo = *(int*)*ip;
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);
+	if(lo < hi) {
+		kernel_copy((Array)*(ip+4) + lo, (Array)*(ip+3) + lo, hi - lo);
+		*(int*)*ip = hi;
+	}
+	ip += 5;
+	NEXT
+}
+
+HANDLER(OP_IOTA) {
+	int lo = *(int*)*ip;
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);
+	if(lo < hi) {
+		kernel_iota((Array)*(ip+3) + lo, hi - lo, lo);
+		*(int*)*ip = hi;
+	}
+	ip += 4;
+	NEXT
+}
+
+HANDLER(OP_COUNT_IF) {
+	int lo = *(int*)*ip;
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);
+	if(lo < hi) {
+		long count = kernel_count((Array)*(ip+5) + lo, hi - lo, *(int*)*(ip+4), *(int*)*(ip+3));
+		*(int*)*(ip+6) = (unsigned int)*(int*)*(ip+6) + (unsigned int)count;
+		*(int*)*ip = hi;
+	}
+	ip += 7;
+	NEXT
+}
+
+// moves the counter to the first match (or the end), the loop then runs from there
+HANDLER(OP_SEARCH) {
+	int lo = *(int*)*ip;
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);
+	if(lo < hi)
+		*(int*)*ip = lo + kernel_search((Array)*(ip+5) + lo, hi - lo, *(int*)*(ip+4), *(int*)*(ip+3));
+	ip += 6;
+	NEXT
+}
+
+// Reductions execute the iterations counter .. bound-1 (or bound, if <=) but the last,
+// reading array0[base0 + k*stride0]. They are skipped unless at least 2 iterations remain.
+#define REDUCTION_RANGE																\
+	int lo = *(int*)*ip;															\
+	long long hi = *(int*)*(ip+1) + (long long)*(int*)*(ip+2);						\
+	if(hi - lo < 2) {																\
+		ip += length;																\
+		NEXT																		\
+	}																				\
+	long n = hi - lo - 1;															\
+	*(int*)*ip = hi - 1;
+#define READ0 (Array)*(ip+5), *(int*)*(ip+3), *(int*)*(ip+4)
+#define READ1 (Array)*(ip+8), *(int*)*(ip+6), *(int*)*(ip+7)
+
+HANDLER(OP_SUM_V) {
+	const int length = 7;
+	REDUCTION_RANGE
+	*(int*)*(ip+6) = (unsigned int)*(int*)*(ip+6) + kernel_sum(READ0, n);
+	ip += length;
+	NEXT
+}
+
+HANDLER(OP_SUM_A) {
+	const int length = 8;
+	REDUCTION_RANGE
+	int* acc = &((Array)*(ip+7))[*(int*)*(ip+6)];
+	*acc = (unsigned int)*acc + kernel_sum(READ0, n);
+	ip += length;
+	NEXT
+}
+
+HANDLER(OP_DOT_V) {
+	const int length = 10;
+	REDUCTION_RANGE
+	*(int*)*(ip+9) = (unsigned int)*(int*)*(ip+9) + kernel_dot(READ0, READ1, n);
+	ip += length;
+	NEXT
+}
+
+HANDLER(OP_DOT_A) {
+	const int length = 11;
+	REDUCTION_RANGE
+	int* acc = &((Array)*(ip+10))[*(int*)*(ip+9)];
+	*acc = (unsigned int)*acc + kernel_dot(READ0, READ1, n);
+	ip += length;
+	NEXT
+}
+
+HANDLER(OP_MIN) {
+	const int length = 7;
+	REDUCTION_RANGE
+	*(int*)*(ip+6) = kernel_min(READ0, n, *(int*)*(ip+6));
+	ip += length;
+	NEXT
+}
+
+HANDLER(OP_MAX) {
+	const int length = 7;
+	REDUCTION_RANGE
+	*(int*)*(ip+6) = kernel_max(READ0, n, *(int*)*(ip+6));
+	ip += length;
+	NEXT
+}
+
+// the stride is the change of the index since the previous iteration (a wrong one only
+// prefetches a useless address)
+HANDLER(OP_PREFETCH) {
+	unsigned int x = *(int*)*ip;
+	unsigned int* prev = *(ip+1);
+	if(runtime->prefetch != 0)
+		__builtin_prefetch((Array)*(ip+2) + (int)(x + (x - *prev) * runtime->prefetch));
+	*prev = x;
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_LOAD_BYTE) {
+	*(int*)*(ip+2) = load_element(*(ip+1), *(int*)*ip, 8);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_STORE_BYTE) {
+	store_element(*(ip+2), *(int*)*(ip+1), 8, *(int*)*ip);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_LOAD_SHORT) {
+	*(int*)*(ip+2) = load_element(*(ip+1), *(int*)*ip, 16);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_STORE_SHORT) {
+	store_element(*(ip+2), *(int*)*(ip+1), 16, *(int*)*ip);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_LOAD_BIT) {
+	*(int*)*(ip+2) = load_element(*(ip+1), *(int*)*ip, 1);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_STORE_BIT) {
+	store_element(*(ip+2), *(int*)*(ip+1), 1, *(int*)*ip);
+	ip += 3;
+	NEXT
+}
+
+HANDLER(OP_READ_ARRAY) {
+	flush_output(runtime);
+	if(!read_array(runtime, *(ip+1), *(int*)*ip)) {
+		*status = RUN_NO_INPUT;
+		return NULL;
+	}
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_WRITE_ARRAY) {
+	write_array(runtime, *(ip+1), *(int*)*ip, false);
+	ip += 2;
+	NEXT
+}
+
+HANDLER(OP_WRITELN_ARRAY) {
+	write_array(runtime, *(ip+1), *(int*)*ip, true);
+	ip += 2;
+	NEXT
+}
+
+// form: ElementOp * 4, plus 1 if x is an array, plus 2 if y is
+HANDLER(OP_ARRAY_OP) {
+	int form = *(int*)*ip;
+	const int* x = *(ip+1);
+	const int* y = *(ip+2);
+	Array a = *(ip+3);
+	int n = a[-1];
+	if(((form & 1) && x[-1] != n) || ((form & 2) && y[-1] != n)) {
+		flush_output(runtime);
+		*status = RUN_SIZE_MISMATCH;
+		return NULL;
+	}
+	kernel_elementwise(a, x, form & 1, y, form >> 1 & 1, n, form >> 2);
+	ip += 4;
+	NEXT
+}
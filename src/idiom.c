@@ -0,0 +1,353 @@
+#include <string.h>
+
+#include "idiom.h"
+
+typedef enum {
+	NOT_AFFINE,
+	INVARIANT,		// does not change in the loop
+	AFFINE,			// changes by a fixed amount in each iteration
+} Affinity;
+
+static bool is_literal(String token) {
+	return *token >= '0' && *token <= '9';
+}
+
+static bool is_scalar(String token) {
+	return strchr(token, '[') == NULL;
+}
+
+// for token "a[x]" returns a copy of "a", and of "x" in *index. NULL for scalars
+static String split_element(String token, String* index, Arena arena) {
+	String bracket = strchr(token, '[');
+	if(bracket == NULL)
+		return NULL;
+
+	String name = arena_strdup(arena, token);
+	name[bracket - token] = '\0';
+	*index = name + (bracket - token) + 1;
+	(*index)[strlen(*index) - 1] = '\0';
+	return name;
+}
+
+// for token "a[index]" returns a copy of "a", otherwise NULL
+static String element_of(String token, String index, Arena arena) {
+	String element_index;
+	String array = split_element(token, &element_index, arena);
+	return array != NULL && strcmp(element_index, index) == 0 ? array : NULL;
+}
+
+// counter = counter + 1  or  counter = 1 + counter
+static bool is_increment(Statement stm, String counter) {
+	String* t = stm->tokens;
+	return stm->type == ASSIGN_EXP && strcmp(t[0], counter) == 0 && strcmp(t[3], "+") == 0 &&
+		((strcmp(t[2], counter) == 0 && strcmp(t[4], "1") == 0) ||
+		 (strcmp(t[4], counter) == 0 && strcmp(t[2], "1") == 0));
+}
+
+// number of assignments to the scalar name in prog
+static int writes(Program prog, String name) {
+	int n = 0;
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		if((stm->type == ASSIGN_VAR || stm->type == ASSIGN_EXP) && strcmp(stm->tokens[0], name) == 0)
+			n++;
+		n += writes(stm->body, name) + writes(stm->else_body, name);
+	}
+	return n;
+}
+
+// number of reads of the scalar name in prog (the index of an assigned element is read)
+static int reads(Program prog, String name) {
+	int n = 0;
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		String* t = stm->tokens;
+		String operands[3] = { NULL, NULL, NULL };
+		switch(stm->type) {
+			case ASSIGN_VAR:	operands[0] = t[2];	operands[2] = t[0];					break;
+			case ASSIGN_EXP:	operands[0] = t[2];	operands[1] = t[4];	operands[2] = t[0];	break;
+			case IF:
+			case WHILE:			operands[0] = t[1];	operands[1] = t[3];					break;
+			default:																	break;
+		}
+		for(int i = 0; i < 3; i++) {
+			if(operands[i] == NULL)
+				continue;
+			String bracket = strchr(operands[i], '[');
+			if(bracket != NULL)
+				n += strncmp(bracket + 1, name, strlen(name)) == 0 && strcmp(bracket + 1 + strlen(name), "]") == 0;
+			else
+				n += i < 2 && strcmp(operands[i], name) == 0;
+		}
+		n += reads(stm->body, name) + reads(stm->else_body, name);
+	}
+	return n;
+}
+
+// affinity of a scalar token at some point of the body, assigned holds the
+// scalars assigned so far (with their affinity)
+static Affinity affinity(String token, LoopIdiom* idiom, Program body, Map assigned) {
+	if(!is_scalar(token))
+		return NOT_AFFINE;
+	if(is_literal(token))
+		return INVARIANT;
+	if(strcmp(token, idiom->counter) == 0)
+		return AFFINE;
+	Affinity a = (intptr_t)map_find(assigned, token);
+	if(a != NOT_AFFINE)
+		return a;
+	return writes(body, token) == 0 ? INVARIANT : NOT_AFFINE;
+}
+
+// index statement, an affine expression of the counter: +, - of affine, * by an invariant
+static Affinity expression_affinity(Statement stm, LoopIdiom* idiom, Program body, Map assigned) {
+	String* t = stm->tokens;
+	Affinity x = affinity(t[2], idiom, body, assigned);
+	if(stm->type == ASSIGN_VAR)
+		return x;
+
+	Affinity y = affinity(t[4], idiom, body, assigned);
+	if(x == NOT_AFFINE || y == NOT_AFFINE || (t[3][0] == '*' && x == AFFINE && y == AFFINE) || strchr("+-*", t[3][0]) == NULL)
+		return NOT_AFFINE;
+	return x == AFFINE || y == AFFINE ? AFFINE : INVARIANT;
+}
+
+// if a[x] < m  (or mirrored)  with body  m = a[x]
+static bool match_min_max(Statement stm, LoopIdiom* idiom, Arena arena) {
+	String* t = stm->tokens;
+	Statement body = stm->body;
+	if(stm->else_body != NULL || body == NULL || body->next != NULL || body->type != ASSIGN_VAR || (t[2][0] != '<' && t[2][0] != '>'))
+		return false;
+
+	bool element_left = !is_scalar(t[1]);
+	String element = element_left ? t[1] : t[3];
+	String m = element_left ? t[3] : t[1];
+	if(!is_scalar(m) || is_literal(m) || is_scalar(element) || strcmp(body->tokens[0], m) != 0 || strcmp(body->tokens[2], element) != 0)
+		return false;
+
+	// a[x] < m  and  m > a[x]  keep the minimum
+	idiom->kind = (t[2][0] == '<') == element_left ? IDIOM_MIN : IDIOM_MAX;
+	idiom->acc = m;
+	idiom->reads[0] = split_element(element, &idiom->indexes[0], arena);
+	idiom->update = stm;
+	return true;
+}
+
+// s = s + a[x]  or  s = s + t  with t the product
+static bool match_update(Statement stm, LoopIdiom* idiom, Arena arena) {
+	String* t = stm->tokens;
+	if(stm->type != ASSIGN_EXP || t[3][0] != '+')
+		return false;
+
+	String other = strcmp(t[0], t[2]) == 0 ? t[4] : strcmp(t[0], t[4]) == 0 ? t[2] : NULL;
+	if(other == NULL)
+		return false;
+	if(!is_scalar(other)) {
+		idiom->kind = IDIOM_SUM;
+		idiom->reads[0] = split_element(other, &idiom->indexes[0], arena);
+	} else if(idiom->product != NULL && strcmp(other, idiom->product->tokens[0]) == 0) {
+		idiom->kind = IDIOM_DOT;
+	} else {
+		return false;
+	}
+
+	idiom->acc = t[0];
+	if(!is_scalar(t[0]))
+		idiom->acc = split_element(t[0], &idiom->acc_index, arena);
+	idiom->update = stm;
+	return true;
+}
+
+// if a[i] <op> v  (or mirrored)  with body  break/continue (search) or  c = c + 1 (count)
+static bool match_search_count(Statement stm, LoopIdiom* idiom, Arena arena) {
+	String* t = stm->tokens;
+	Statement body = stm->body;
+	if(stm->type != IF || stm->else_body != NULL || body == NULL || body->next != NULL)
+		return false;
+
+	bool element_left = !is_scalar(t[1]);
+	String value = element_left ? t[3] : t[1];
+	String array = element_of(element_left ? t[1] : t[3], idiom->counter, arena);
+	if(array == NULL || !is_scalar(value) || strcmp(value, idiom->counter) == 0 || strcmp(array, idiom->counter) == 0)
+		return false;
+
+	// as  a[i] <compare> v
+	String op = t[2];
+	idiom->compare =
+		strcmp(op, "==") == 0 ? CMP_EQ :
+		strcmp(op, "!=") == 0 ? CMP_NEQ :
+		strcmp(op, "<") == 0 ? (element_left ? CMP_LT : CMP_GT) :
+		strcmp(op, "<=") == 0 ? (element_left ? CMP_LE : CMP_GE) :
+		strcmp(op, ">") == 0 ? (element_left ? CMP_GT : CMP_LT) :
+		(element_left ? CMP_GE : CMP_LE);
+	idiom->array = array;
+	idiom->source = value;
+
+	if(body->type == BREAK || body->type == CONTINUE) {
+		idiom->kind = IDIOM_SEARCH;
+		return true;
+	}
+	String c = body->tokens[0];
+	if(is_increment(body, c) && is_scalar(c) && strcmp(c, idiom->counter) != 0 && strcmp(c, idiom->bound) != 0 && strcmp(c, value) != 0) {
+		idiom->kind = IDIOM_COUNT;
+		idiom->acc = c;
+		return true;
+	}
+	return false;
+}
+
+static bool match_reduction(Statement loop, LoopIdiom* idiom, Arena arena) {
+	Program body = loop->body;
+	Map assigned = map_create((CompareFunc)strcmp, NULL, NULL);
+	map_set_hash_function(assigned, hash_string);
+
+	// in execution order, the indexes must be affine where they are used
+	bool ok = true;
+	for(Statement stm = body; stm->next != NULL && ok; stm = stm->next) {
+		String* t = stm->tokens;
+		if(idiom->update == NULL && stm->type == IF && match_min_max(stm, idiom, arena)) {
+			ok = affinity(idiom->indexes[0], idiom, body, assigned) != NOT_AFFINE;
+
+		} else if(idiom->product == NULL && stm->type == ASSIGN_EXP && t[3][0] == '*' && is_scalar(t[0]) && !is_scalar(t[2]) && !is_scalar(t[4])) {
+			idiom->product = stm;
+			idiom->reads[0] = split_element(t[2], &idiom->indexes[0], arena);
+			idiom->reads[1] = split_element(t[4], &idiom->indexes[1], arena);
+			ok = affinity(idiom->indexes[0], idiom, body, assigned) != NOT_AFFINE &&
+				 affinity(idiom->indexes[1], idiom, body, assigned) != NOT_AFFINE;
+
+		} else if(idiom->update == NULL && match_update(stm, idiom, arena)) {
+			ok = idiom->kind == IDIOM_DOT || affinity(idiom->indexes[0], idiom, body, assigned) != NOT_AFFINE;
+
+		} else if((stm->type == ASSIGN_VAR || stm->type == ASSIGN_EXP) && is_scalar(t[0])) {
+			Affinity a = expression_affinity(stm, idiom, body, assigned);
+			ok = a != NOT_AFFINE;
+			map_insert(assigned, t[0], (Pointer)(intptr_t)a);
+
+		} else {
+			ok = false;
+		}
+	}
+	map_destroy(assigned);
+
+	ok = ok && idiom->update != NULL && (idiom->product != NULL) == (idiom->kind == IDIOM_DOT) &&
+		writes(body, idiom->counter) == 1 && writes(body, idiom->bound) == 0;
+	if(ok && idiom->kind == IDIOM_DOT) {
+		String product = idiom->product->tokens[0];
+		ok = writes(body, product) == 1 && reads(body, product) == 1 && strcmp(product, idiom->counter) != 0;
+	}
+
+	// the accumulator is only used by the update, and does not alias the reads
+	if(ok && idiom->acc_index == NULL) {
+		ok = strcmp(idiom->acc, idiom->counter) != 0 && strcmp(idiom->acc, idiom->bound) != 0 &&
+			 writes(body, idiom->acc) == 1 && reads(body, idiom->acc) == 1;
+	} else if(ok) {
+		ok = is_scalar(idiom->acc_index) && (is_literal(idiom->acc_index) || writes(body, idiom->acc_index) == 0) &&
+			 strcmp(idiom->acc_index, idiom->counter) != 0 &&
+			 strcmp(idiom->acc, idiom->reads[0]) != 0 && (idiom->reads[1] == NULL || strcmp(idiom->acc, idiom->reads[1]) != 0);
+	}
+	return ok;
+}
+
+// while i < n  ...  i = i + 1  (or any of the forms in idiom.h), sets counter, bound, inclusive
+static bool match_counted_loop(Statement loop, LoopIdiom* idiom) {
+	String* t = loop->tokens;
+	Statement body = loop->body;
+	bool not_equal = strcmp(t[2], "!=") == 0;
+	if(loop->type != WHILE || (t[2][0] != '<' && t[2][0] != '>' && !not_equal) || body == NULL || body->next == NULL)
+		return false;
+
+	Statement last = body;
+	while(last->next != NULL)
+		last = last->next;
+
+	// i != n  is the same as  i < n  if i <= n at the start, which is checked at run time
+	bool up = not_equal ? is_increment(last, t[1]) : t[2][0] == '<';
+	idiom->counter = up ? t[1] : t[3];
+	idiom->bound = up ? t[3] : t[1];
+	idiom->inclusive = !not_equal && t[2][1] == '=';
+	return !is_literal(idiom->counter) && is_scalar(idiom->counter) && is_scalar(idiom->bound) &&
+		strcmp(idiom->counter, idiom->bound) != 0 && is_increment(last, idiom->counter);
+}
+
+LoopIdiom idiom_match(Statement loop, Arena arena) {
+	LoopIdiom none = { .kind = IDIOM_NONE };
+	LoopIdiom idiom = { .kind = IDIOM_NONE };
+	if(!match_counted_loop(loop, &idiom))
+		return none;
+
+	Statement body = loop->body;
+	Statement last = body;
+	while(last->next != NULL)
+		last = last->next;
+	bool not_equal = strcmp(loop->tokens[2], "!=") == 0;
+
+	// search, count
+	if(body->next == last && match_search_count(body, &idiom, arena))
+		return !not_equal || idiom.kind == IDIOM_SEARCH ? idiom : none;
+	if(not_equal)
+		return none;
+
+	// fill, copy, iota
+	if(body->next == last && body->type == ASSIGN_VAR && (idiom.array = element_of(body->tokens[0], idiom.counter, arena)) != NULL) {
+		String x = body->tokens[2];
+		if(strcmp(x, idiom.counter) == 0) {
+			idiom.kind = IDIOM_IOTA;
+		} else if(is_scalar(x)) {
+			idiom.kind = IDIOM_FILL;
+			idiom.source = x;
+		} else if((idiom.source = element_of(x, idiom.counter, arena)) != NULL) {
+			idiom.kind = IDIOM_COPY;
+		}
+		return idiom.kind != IDIOM_NONE ? idiom : none;
+	}
+
+	return match_reduction(loop, &idiom, arena) ? idiom : none;
+}
+
+void idiom_prefetch(Statement loop, Arena arena) {
+	LoopIdiom idiom = { .kind = IDIOM_NONE };
+	if(!match_counted_loop(loop, &idiom))
+		return;
+
+	Program body = loop->body;
+	Map assigned = map_create((CompareFunc)strcmp, NULL, NULL);
+	map_set_hash_function(assigned, hash_string);
+	Set found = set_create((CompareFunc)strcmp, NULL);		// "index]array" of the prefetched elements
+
+	for(Statement stm = body; stm != NULL; stm = stm->next) {
+		String* t = stm->tokens;
+		String operands[3] = { NULL, NULL, NULL };
+		switch(stm->type) {
+			case ASSIGN_VAR:	operands[0] = t[2];	operands[1] = t[0];					break;
+			case ASSIGN_EXP:	operands[0] = t[2];	operands[1] = t[4];	operands[2] = t[0];	break;
+			case IF:
+			case WHILE:			operands[0] = t[1];	operands[1] = t[3];					break;
+			default:																	break;
+		}
+
+		// the counter's elements are sequential, the hardware prefetches them
+		for(int i = 0; i < 3; i++) {
+			String index;
+			String array = operands[i] != NULL ? split_element(operands[i], &index, arena) : NULL;
+			if(array == NULL || !is_scalar(index) || strcmp(index, idiom.counter) == 0 ||
+			   affinity(index, &idiom, body, assigned) != AFFINE)
+				continue;
+
+			size_t size = strlen(index) + strlen(array) + 2;
+			String key = arena_alloc(arena, size);
+			snprintf(key, size, "%s]%s", index, array);
+			if(set_find(found, key) != NULL)
+				continue;
+			set_insert(found, key);
+
+			Prefetch prefetch = arena_alloc(arena, sizeof(*prefetch));
+			prefetch->index = index;
+			prefetch->array = array;
+			prefetch->next = stm->prefetch;
+			stm->prefetch = prefetch;
+		}
+
+		if((stm->type == ASSIGN_VAR || stm->type == ASSIGN_EXP) && is_scalar(t[0]))
+			map_insert(assigned, t[0], (Pointer)(intptr_t)expression_affinity(stm, &idiom, body, assigned));
+	}
+	map_destroy(assigned);
+	set_destroy(found);
+}
@@ -0,0 +1,83 @@
+
+#pragma once
+
+#include "parser.h"
+#include "kernels.h"
+
+// Loop idioms, loops that are compiled to bulk instructions. They have the form
+//
+//   while i < n            (or <=, or the mirrored >, >=, with n a scalar not modified in the loop)
+//       <body>
+//       i = i + 1
+//
+// Fill, copy, iota and count loops are replaced by a single instruction, the body is one of
+//
+//   fill:  a[i] = v        (v a scalar other than i)
+//   copy:  a[i] = b[i]
+//   iota:  a[i] = i
+//   count: if a[i] == v    (or any comparison, mirrored too, v not modified in the loop)
+//              c = c + 1
+//
+// Search loops are preceded by an instruction that skips the iterations in which the
+// condition is false, the loop itself then executes the matching one (so the exit state,
+// eg the break/continue target, is the same). The loop can also be  while i != n, the body is
+//
+//   search: if a[i] == v   (or any comparison, mirrored too)
+//               break      (or continue, any level)
+//
+// Reduction loops are preceded by an instruction that executes all their iterations
+// but the last, the loop itself then executes the last one (so all variables end up as
+// after the loop). Their body contains scalar statements computing indexes that are affine
+// in i (eg x = i * L, x = x + j, with L, j not modified in the loop) and one of
+//
+//   sum:   s = s + a[x]
+//   dot:   t = a[x] * b[y]   followed by   s = s + t
+//   min:   if a[x] < m       (or <=, or mirrored)  with body  m = a[x]
+//   max:   if a[x] > m       (or >=, or mirrored)  with body  m = a[x]
+//
+// where the sum/dot accumulator s is a scalar, or an element c[z] with z not modified
+// in the loop and c not read otherwise.
+//
+// In all cases the instruction leaves i with its value after the loop (or before the
+// last iteration for reductions, or the matching one for search).
+
+typedef enum {
+	IDIOM_NONE,
+	IDIOM_FILL,
+	IDIOM_COPY,
+	IDIOM_IOTA,
+	IDIOM_COUNT,
+	IDIOM_SUM,
+	IDIOM_DOT,
+	IDIOM_MIN,
+	IDIOM_MAX,
+	IDIOM_SEARCH,
+} IdiomKind;
+
+typedef struct {
+	IdiomKind kind;
+	String counter, bound;
+	bool inclusive;			// <=
+	String array;			// fill/copy/iota: the written array, count/search: the read array
+	String source;			// fill/count/search: the value, copy: the read array
+	Comparison compare;		// count/search: array[i] <compare> value
+
+	// reductions
+	String reads[2];		// the read arrays (2 for dot)
+	String indexes[2];		// and their indexes
+	String acc;				// accumulator scalar, or array if acc_index != NULL (count: the counter)
+	String acc_index;
+	Statement product;		// the statements that are not index computations
+	Statement update;
+} LoopIdiom;
+
+// Returns the idiom of loop, of kind IDIOM_NONE if it is not one. Names are allocated
+// in arena, the loop's tokens are not modified.
+LoopIdiom idiom_match(Statement loop, Arena arena);
+
+// Prefetching. In a loop of the above form, the elements a[x] accessed by the top level
+// statements of the body, with x affine in i (and not i itself, whose elements are
+// sequential), are prefetched some iterations ahead by an OP_PREFETCH before the
+// statement. It finds the stride as the difference of x from the previous iteration.
+// Sets stm->prefetch for the statements of loop's body.
+void idiom_prefetch(Statement loop, Arena arena);
@@ -2,407 +2,808 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 
-#include "ADTMap.h"
 #include "interpreter.h"
+#include "kernels.h"
+#include "counters.h"
 
-// if PROFILE is defined, count how many times each instruction is executed
-// #define PROFILE
+// the ip of the run executing in each thread (see interpreter.h)
+__thread void*** interpreter_ip;
 
-#ifdef PROFILE
-#define INC_COUNTER ((BCInstruction)map_find(thread_to_instr, ip))->exec_count++;
-#else
-#define INC_COUNTER
-#endif
 
-#define NEXT INC_COUNTER goto **ip++;
-
-
-bool is_jump(BCInstruction instr) {
-	return
-		instr->opcode == OP_JUMP ||
-		(instr->opcode >= OP_EQ_VV && instr->opcode <= OP_LT_AA);
-}
-
-void print_code(Vector code) {
-	String opcodes[] = {
-		"OP_WRITE", "OP_WRITELN", "OP_READ",
-		"OP_LOAD1_V", "OP_LOAD1_A",
-		"OP_LOAD2_V", "OP_LOAD2_A",
-		"OP_STORE_V", "OP_STORE_A",
-		"OP_ASSIGN_VV", "OP_ASSIGN_VA", "OP_ASSIGN_AV", "OP_ASSIGN_AA",
-		"OP_INC_V", "OP_INC_A", "OP_DEC_V", "OP_DEC_A",
-		"OP_JUMP", "OP_RAND", "OP_NEW", "OP_FREE", "OP_SIZE", "OP_HALT",
-		"OP_ADD_VVV", "OP_ADD_VVA", "OP_ADD_VAA", "OP_ADD_AVV", "OP_ADD_AVA", "OP_ADD_AAA",
-		"OP_SUB_VVV", "OP_SUB_VVA", "OP_SUB_VAA", "OP_SUB_AVV", "OP_SUB_AVA", "OP_SUB_AAA",
-		"OP_MUL", "OP_DIV", "OP_MOD",
-		"OP_EQ_VV", "OP_EQ_VA", "OP_EQ_AA", "OP_NEQ_VV", "OP_NEQ_VA", "OP_NEQ_AA",
-		"OP_LE_VV", "OP_LE_VA", "OP_LE_AV", "OP_LE_AV", "OP_LT_VV", "OP_LT_VA", "OP_LT_AV", "OP_LT_AA",
-	};
-
-	for(int i = 0; i < vector_size(code); i++) {
-		BCInstruction instr = vector_get_at(code, i);
-		printf("%-12s (%d)", opcodes[instr->opcode], instr->exec_count);
-		if(is_jump(instr))
-			printf(" %d", instr->n);
-		for(int i = 0; i < instr->arg_n; i++)
-			printf(" %p", instr->args[i]);
-		printf("\n");
+#define OPCODE_NAME(op) #op,
+
+static String opcode_names[] = { OPCODES(OPCODE_NAME) };
+
+String interpreter_opcode_name(Opcode opcode) {
+	return opcode_names[opcode];
+}
+
+void print_instruction(Bytecode bytecode, int pos, FILE* out) {
+	fprintf(out, "%s", opcode_names[WORD_VALUE(bytecode->words[pos])]);
+	for(int i = pos + 1; i < bytecode->word_n && WORD_TAG(bytecode->words[i]) != TAG_OPCODE; i++) {
+		Word word = bytecode->words[i];
+		switch(WORD_TAG(word)) {
+			case TAG_JUMP:	fprintf(out, " -> %d", i + WORD_VALUE(word));	break;
+			case TAG_VAR:	fprintf(out, " %s", bytecode->var_names[WORD_VALUE(word)]);		break;
+			case TAG_ARRAY:	fprintf(out, " %s[]", bytecode->array_names[WORD_VALUE(word)]);	break;
+		}
 	}
 }
 
-int compare_pointers(Pointer a, Pointer b) {
-	return a - b;
-}
-
-void interpreter_run(Runtime runtime) {
-	if(runtime->verbose)
-		print_code(runtime->code);
-
-	void* labels[] = {
-		&&OP_WRITE, &&OP_WRITELN, &&OP_READ,
-		&&OP_LOAD1_V, &&OP_LOAD1_A,
-		&&OP_LOAD2_V, &&OP_LOAD2_A,
-		&&OP_STORE_V, &&OP_STORE_A,
-		&&OP_ASSIGN_VV, &&OP_ASSIGN_VA, &&OP_ASSIGN_AV, &&OP_ASSIGN_AA, 
-		&&OP_INC_V, &&OP_INC_A, &&OP_DEC_V, &&OP_DEC_A,
-		&&OP_JUMP, &&OP_RAND, &&OP_NEW, &&OP_FREE, &&OP_SIZE, &&OP_HALT,
-		&&OP_ADD_VVV, &&OP_ADD_VVA, &&OP_ADD_VAA, &&OP_ADD_AVV, &&OP_ADD_AVA, &&OP_ADD_AAA,
-		&&OP_SUB_VVV, &&OP_SUB_VVA, &&OP_SUB_VAA, &&OP_SUB_AVV, &&OP_SUB_AVA, &&OP_SUB_AAA,
-		&&OP_MUL, &&OP_DIV, &&OP_MOD,
-		&&OP_EQ_VV, &&OP_EQ_VA, &&OP_EQ_AA, &&OP_NEQ_VV, &&OP_NEQ_VA, &&OP_NEQ_AA,
-		&&OP_LE_VV, &&OP_LE_VA, &&OP_LE_AV, &&OP_LE_AA, &&OP_LT_VV, &&OP_LT_VA, &&OP_LT_AV, &&OP_LT_AA,
-	};
-
-	// find thread size
-	int instr_n = vector_size(runtime->code);
-	int thread_n = 0;
-	for(int i = 0; i < instr_n; i++) {
-		BCInstruction instr = vector_get_at(runtime->code, i);
-		thread_n += 1 + instr->arg_n + (is_jump(instr) ? 1 : 0);
+// prints the bytecode, with the execution count of each instruction if exec_count != NULL
+void print_code(Bytecode bytecode, uint64_t* exec_count, FILE* out) {
+	// each instruction is printed with its thread position and source line
+	for(int i = 0; i < bytecode->word_n; i++) {
+		if(WORD_TAG(bytecode->words[i]) != TAG_OPCODE)
+			continue;
+		fprintf(out, "%6d %4d (%" PRIu64 ") ", i, bytecode->lines[i], exec_count ? exec_count[i] : 0);
+		print_instruction(bytecode, i, out);
+		fprintf(out, "\n");
 	}
+}
 
-	// setup thread
-	void** thread = malloc(thread_n * sizeof(*thread));
-	void** t = thread;
+static int compare_pointers(Pointer a, Pointer b) {
+	return a < b ? -1 : a > b;		// a - b does not fit in an int
+}
 
-	#ifdef PROFILE
-	// map thread locations to instructions, if profiling
-	Map thread_to_instr = map_create(compare_pointers, NULL, NULL);
+// Large arrays are mapped aligned to huge pages, so that the TLB covers them with few entries.
+// The mapping's length is stored before the array (keeping it cache line aligned).
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define HUGE_HEADER 64
+
+static void* map_huge(size_t size, Runtime runtime) {
+	size_t length = (size + HUGE_HEADER + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	char* m = MAP_FAILED;
+	#ifdef MAP_HUGETLB
+	if(runtime->hugetlb && (m = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) != MAP_FAILED)
+		runtime->hugetlb_n++;
 	#endif
 
-	for(int i = 0; i < instr_n; i++) {
-		BCInstruction instr = vector_get_at(runtime->code, i);
+	if(m == MAP_FAILED) {
+		// transparent huge pages, the mapping is trimmed to an aligned range
+		char* raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(raw == MAP_FAILED)
+			return NULL;
+		m = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+		if(m > raw)
+			munmap(raw, m - raw);
+		munmap(m + length, raw + HUGE_PAGE_SIZE - m);
+		#ifdef MADV_HUGEPAGE
+		madvise(m, length, MADV_HUGEPAGE);
+		#endif
+	}
+
+	*(size_t*)m = length;
+	runtime->huge_n++;
+	runtime->huge_bytes += length;
+	return m + HUGE_HEADER;
+}
 
-		instr->thread_pos = t;
-		*t++ = labels[instr->opcode];
+static void unmap_huge(Pointer p) {
+	char* m = (char*)p - HUGE_HEADER;
+	munmap(m, *(size_t*)m);
+}
 
-		// leave space for the target thread address, we'll fill it after we know the position of all instructions
-		if(is_jump(instr))
-			t++;
-		
-		for(int j = 0; j < instr->arg_n; j++)
-			*t++ = instr->args[j];
+// ints needed for an array of size elements of the given bits, plus the size before it
+static int array_ints(int size, int bits) {
+	return 1 + ((long long)size * bits + 31) / 32;
+}
 
-		#ifdef PROFILE
-		map_insert(thread_to_instr, instr->thread_pos, instr);
-		#endif
+// these should be called for all memory allocated for the program's arrays
+static int* alloc_ints(int int_n, Runtime runtime) {
+	size_t size = (size_t)int_n * sizeof(int);
+	int* p;
+	if(runtime->huge_threshold != 0 && size >= runtime->huge_threshold && (p = map_huge(size, runtime)) != NULL) {
+		set_insert(runtime->huge_allocs, p);
+	} else {
+		p = calloc(int_n, sizeof(int));
+		set_insert(runtime->allocs, p);
 	}
-	assert(t - thread == thread_n);
+	runtime->memory_used += size;
+	if(runtime->memory_used > runtime->memory_peak)
+		runtime->memory_peak = runtime->memory_used;
+	return p;
+}
+
+static void free_ints(Pointer p, int bits, Runtime runtime) {
+	Set allocs = set_find(runtime->huge_allocs, p) != NULL ? runtime->huge_allocs : runtime->allocs;
+	if(set_find(allocs, p) != NULL)		// p[0] is the array's size
+		runtime->memory_used -= (size_t)array_ints(*(int*)p, bits) * sizeof(int);
+	set_remove(allocs, p);	// this does the free (if p was alloced, placeholders are not)
+}
+
+static void write_output(Runtime runtime, const char* buf, int len) {
+	runtime->io.write(runtime->io.data, buf, len);
+	runtime->output_bytes += len;
+}
+
+static void flush_output(Runtime runtime) {
+	if(runtime->out_n > 0)
+		write_output(runtime, runtime->out, runtime->out_n);
+	runtime->out_n = 0;
+}
+
+// replaces all occurrences of old_array in the thread table, after OP_NEW and OP_FREE
+static void patch_thread(Runtime runtime, int* old_array, int* new_array) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	void** thread = runtime->thread;
+	for(int i = 0; i < runtime->thread_n; i++)
+		if(thread[i] == old_array)
+			thread[i] = new_array;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	runtime->patch_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+// appends value followed by end to the output buffer
+static void write_int(Runtime runtime, int value, char end) {
+	if(runtime->out_n > OUTPUT_BUFFER_SIZE - 16)
+		flush_output(runtime);
+
+	char digits[12];
+	int n = 0;
+	unsigned int u = value < 0 ? -(unsigned int)value : (unsigned int)value;
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while(u != 0);
+	if(value < 0)
+		digits[n++] = '-';
+
+	char* out = runtime->out + runtime->out_n;
+	for(int i = n - 1; i >= 0; i--)
+		*out++ = digits[i];
+	*out++ = end;
+	runtime->out_n = out - runtime->out;
+}
 
-	// setup jumps, now that we know the location of all instructions in the thread
-	for(int i = 0; i < instr_n; i++) {
-		BCInstruction instr = vector_get_at(runtime->code, i);
+// Elements of narrow arrays are converted like in C (byte/short wrap around). The bits of
+// element k are in byte k/8 (the shift of negative indexes also rounds down).
+static inline int load_element(Array a, int k, int bits) {
+	switch(bits) {
+		case 1:		return ((uint8_t*)a)[k >> 3] >> (k & 7) & 1;
+		case 8:		return ((int8_t*)a)[k];
+		case 16:	return ((int16_t*)a)[k];
+		default:	return a[k];
+	}
+}
 
-		if(is_jump(instr)) {
-			BCInstruction target = vector_get_at(runtime->code, i + 1 + instr->n);
-			*(instr->thread_pos+1) = target->thread_pos;
+static inline void store_element(Array a, int k, int bits, int value) {
+	switch(bits) {
+		case 1: {
+			uint8_t* byte = &((uint8_t*)a)[k >> 3];
+			*byte = (*byte & ~(1 << (k & 7))) | (value & 1) << (k & 7);
+			break;
 		}
+		case 8:		((int8_t*)a)[k] = (int8_t)value;	break;
+		case 16:	((int16_t*)a)[k] = (int16_t)value;	break;
+		default:	a[k] = value;						break;
+	}
+}
+
+// reads up to n values with a single io call if possible
+static int read_ints(Runtime runtime, int* values, int n) {
+	if(runtime->io.read_n != NULL)
+		return runtime->io.read_n(runtime->io.data, values, n);
+	int k = 0;
+	while(k < n && runtime->io.read(runtime->io.data, &values[k]))
+		k++;
+	return k;
+}
+
+// reads all elements of a, false if the input ends before
+static bool read_array(Runtime runtime, Array a, int bits) {
+	int n = a[-1];
+	if(bits == 32)
+		return read_ints(runtime, a, n) == n;
+
+	int values[1024];
+	for(int k = 0; k < n; ) {
+		int chunk = n - k < 1024 ? n - k : 1024;
+		int read = read_ints(runtime, values, chunk);
+		for(int i = 0; i < read; i++)
+			store_element(a, k + i, bits, values[i]);
+		if(read < chunk)
+			return false;
+		k += chunk;
+	}
+	return true;
+}
+
+static void write_array(Runtime runtime, Array a, int bits, bool newline) {
+	int n = a[-1];
+	for(int k = 0; k < n; k++)
+		write_int(runtime, load_element(a, k, bits), newline && k == n - 1 ? '\n' : ' ');
+	if(newline && n == 0) {
+		if(runtime->out_n == OUTPUT_BUFFER_SIZE)
+			flush_output(runtime);
+		runtime->out[runtime->out_n++] = '\n';
 	}
+}
+
+// xorshift64*, returns values in [0, 2^31) like rand()
+static int next_rand(Runtime runtime) {
+	uint64_t x = runtime->rand_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	runtime->rand_state = x;
+	return (x * 0x2545F4914F6CDD1DULL) >> 33;
+}
+
+static bool run_parallel(Runtime runtime, void** ip, RunStatus* status);
+
+// reads a value for OP_READ, NO_INPUT if there is none (so that the handler does not take
+// the address of a local). Not inlined, to keep it out of the hot handlers' registers.
+#define NO_INPUT LLONG_MIN
+
+static __attribute__((noinline)) long long read_value(Runtime runtime) {
+	int value;
+	return runtime->io.read(runtime->io.data, &value) ? value : NO_INPUT;
+}
+
+// Dispatch backends ///////////////////////////////////////////////////////////////////
+//
+// The handlers (handlers.h) are compiled with one of these, chosen at build time with
+// -DINTERPRETER_DISPATCH_<name> (see the Makefile's ipli-fast-<name> targets):
+//
+//   (default)  direct threading: the thread entry of an instruction is its label's address
+//              and each handler jumps to the next one with a computed goto
+//   TOKEN      token threading: entries are opcodes, each handler jumps through a table of
+//              label addresses (one more load per instruction, entries are position
+//              independent)
+//   SWITCH     entries are opcodes, dispatched by a switch in a loop (a single indirect
+//              jump for all instructions, as in a portable C interpreter)
+//   TAILCALL   entries are handler functions, each handler calls the next one in tail
+//              position, with ip, reg1 and reg2 in argument registers. Needs the calls to
+//              become jumps: guaranteed with clang's musttail, done by gcc at -O2 and above
+//              (at -O0 deep runs overflow the stack). interpreter_ip is not published.
+//
+// The entries are what interpreter_labels returns, so the rest of the interpreter (the
+// relocation, profiling, interrupts and parallel workers) does not depend on the backend.
+
+// entries of the profiling and counters handlers, after the opcodes (see relocate_opcode)
+enum { OP_PROFILED = OP_COUNT, OP_COUNTERS };
+
+#if defined(INTERPRETER_DISPATCH_TAILCALL)
+
+#ifdef __has_attribute
+#if __has_attribute(musttail)
+#define MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+#ifndef MUSTTAIL
+#define MUSTTAIL
+#endif
+
+typedef void** (*Handler)(void** ip, int reg1, int reg2, Runtime runtime, RunStatus* status);
+
+#define HANDLER(op) static void** handle_##op(void** ip, int reg1, int reg2, Runtime runtime, RunStatus* status)
+#define NEXT MUSTTAIL return ((Handler)*ip)(ip + 1, reg1, reg2, runtime, status);
+#define DISPATCH(entry) MUSTTAIL return ((Handler)(entry))(ip, reg1, reg2, runtime, status);
+#define PUBLISH_IP()
+
+#include "handlers.h"
+
+#define HANDLER_ENTRY(op) (void*)handle_##op,
+
+// Executes the thread of the runtime from start. When called with runtime == NULL it just
+// returns the entries table.
+static void** run(Runtime runtime, void** start, RunStatus* status) {
+	static void* labels[] = { OPCODES(HANDLER_ENTRY) HANDLER_ENTRY(OP_PROFILED) HANDLER_ENTRY(OP_COUNTERS) };
+	if(runtime == NULL)
+		return labels;
+	return ((Handler)*start)(start + 1, 0, 0, runtime, status);
+}
+
+#else
+
+#if defined(INTERPRETER_DISPATCH_TOKEN)
+#define NEXT goto *targets[(intptr_t)*ip++];
+#define DISPATCH(entry) goto *targets[(intptr_t)(entry)];
+#elif defined(INTERPRETER_DISPATCH_SWITCH)
+#define NEXT goto next;
+#define DISPATCH(entry) { opcode = (intptr_t)(entry); goto dispatch; }
+#else
+#define NEXT goto **ip++;			// gcc syntax, we dereference a void* to jump to that location
+#define DISPATCH(entry) goto *(entry);
+#endif
+
+#if defined(INTERPRETER_DISPATCH_SWITCH)
+#define HANDLER(op) case op:
+#else
+#define HANDLER(op) op:
+#endif
+#define PUBLISH_IP() interpreter_ip = &ip
+
+#define LABEL_ENTRY(op) &&op,
+#define TOKEN_ENTRY(op) (void*)op,
+
+// Executes the thread of the runtime from start. Label addresses are only accessible within
+// this function, so when called with runtime == NULL it just returns the entries table.
+static void** run(Runtime runtime, void** start, RunStatus* status) {
+	#if defined(INTERPRETER_DISPATCH_TOKEN) || defined(INTERPRETER_DISPATCH_SWITCH)
+	static void* labels[] = { OPCODES(TOKEN_ENTRY) TOKEN_ENTRY(OP_PROFILED) TOKEN_ENTRY(OP_COUNTERS) };
+	#else
+	static void* labels[] = { OPCODES(LABEL_ENTRY) &&OP_PROFILED, &&OP_COUNTERS };
+	#endif
+	#if defined(INTERPRETER_DISPATCH_TOKEN)
+	static void* targets[] = { OPCODES(LABEL_ENTRY) &&OP_PROFILED, &&OP_COUNTERS };
+	#endif
+	if(runtime == NULL)
+		return labels;
 
 	register int reg1 = 0;
 	register int reg2 = 0;
-	register void** ip = thread;		// pointer to _next_ instruction
-	NEXT						// gcc syntax, we dereference a void* to jump to that location
-
-	OP_LOAD1_V:
-		reg1 = *(int*)*ip++;
-		NEXT
-
-	OP_LOAD2_V:
-		reg2 = *(int*)*ip++;
-		NEXT
-
-	OP_LOAD1_A:
-		reg1 = ((Array)*(ip+1))[*(int*)*ip];
-		ip += 2;
-		NEXT
-
-	OP_LOAD2_A:
-		reg2 = ((Array)*(ip+1))[*(int*)*ip];
-		ip += 2;
-		NEXT
-
-	OP_STORE_V:
-		*(int*)*ip++ = reg1;
-		NEXT
-
-	OP_STORE_A:
-		((Array)*(ip+1))[*(int*)*ip] = reg1;
-		ip += 2;
-		NEXT
-
-	// assign ///////////////////////
-	OP_ASSIGN_VV:
-		*(int*)*(ip+1) = *(int*)*ip;
-		ip += 2;
-		NEXT
-
-	OP_ASSIGN_VA:
-		*(int*)*(ip+2) = ((Array)*(ip+1))[*(int*)*ip];
-		ip += 3;
-		NEXT
-
-	OP_ASSIGN_AV:
-		((Array)*(ip+2))[*(int*)*(ip+1)] = *(int*)*ip;
-		ip += 3;
-		NEXT
-
-	OP_ASSIGN_AA:
-		((Array)*(ip+3))[*(int*)*(ip+2)] = ((Array)*(ip+1))[*(int*)*ip];
-		ip += 4;
-		NEXT
-
-
-	OP_INC_V:
-		++ *(int*)(*ip++);
-		NEXT
-
-	OP_INC_A:
-		++ ((Array)*(ip+1))[*(int*)*ip];
-		ip += 2;
-		NEXT
-
-	OP_DEC_V:
-		-- *(int*)(*ip++);
-		NEXT
-
-	OP_DEC_A:
-		-- ((Array)*(ip+1))[*(int*)*ip];
-		ip += 2;
-		NEXT
-
-	OP_JUMP:
-		ip = *ip;
-		NEXT
-
-	// ADD /////////////////////////////
-
-	OP_ADD_VVV:
-		*(int*)*(ip+2) = *(int*)*ip + *(int*)*(ip+1);
-		ip += 3;
-		NEXT
-
-	OP_ADD_VVA:
-		*(int*)*(ip+3) = *(int*)*ip + ((Array)*(ip+2))[*(int*)*(ip+1)];
-		ip += 4;
-		NEXT
-
-	OP_ADD_VAA:
-		*(int*)*(ip+4) = ((Array)*(ip+1))[*(int*)*ip] + ((Array)*(ip+3))[*(int*)*(ip+2)];
-		ip += 5;
-		NEXT
-
-	OP_ADD_AVV:
-		((Array)*(ip+3))[*(int*)*(ip+2)] = *(int*)*ip + *(int*)*(ip+1);
-		ip += 4;
-		NEXT
-
-	OP_ADD_AVA:
-		((Array)*(ip+4))[*(int*)*(ip+3)] = *(int*)*ip + ((Array)*(ip+2))[*(int*)*(ip+1)];
-		ip += 5;
-		NEXT
-
-	OP_ADD_AAA:
-		((Array)*(ip+5))[*(int*)*(ip+4)] = ((Array)*(ip+1))[*(int*)*ip] + ((Array)*(ip+3))[*(int*)*(ip+2)];
-		ip += 6;
-		NEXT
-
-	// SUB /////////////////////////////
-
-	OP_SUB_VVV:
-		*(int*)*(ip+2) = *(int*)*ip - *(int*)*(ip+1);
-		ip += 3;
-		NEXT
-
-	OP_SUB_VVA:
-		*(int*)*(ip+3) = *(int*)*ip - ((Array)*(ip+2))[*(int*)*(ip+1)];
-		ip += 4;
-		NEXT
-
-	OP_SUB_VAA:
-		*(int*)*(ip+4) = ((Array)*(ip+1))[*(int*)*ip] - ((Array)*(ip+3))[*(int*)*(ip+2)];
-		ip += 5;
-		NEXT
-
-	OP_SUB_AVV:
-		((Array)*(ip+3))[*(int*)*(ip+2)] = *(int*)*ip - *(int*)*(ip+1);
-		ip += 4;
-		NEXT
-
-	OP_SUB_AVA:
-		((Array)*(ip+4))[*(int*)*(ip+3)] = *(int*)*ip - ((Array)*(ip+2))[*(int*)*(ip+1)];
-		ip += 5;
-		NEXT
-
-	OP_SUB_AAA:
-		((Array)*(ip+5))[*(int*)*(ip+4)] = ((Array)*(ip+1))[*(int*)*ip] - ((Array)*(ip+3))[*(int*)*(ip+2)];
-		ip += 6;
-		NEXT
-
-	/////////////////////
-
-	OP_EQ_VV:
-		ip = *(int*)*(ip+1) == *(int*)*(ip+2)
-			? ip+3 : *ip;
-		NEXT
-
-	OP_EQ_VA:
-		ip = *(int*)*(ip+1) == ((Array)*(ip+3))[*(int*)*(ip+2)]
-			? ip+4 : *ip;
-		NEXT
-
-	OP_EQ_AA:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] == ((Array)*(ip+4))[*(int*)*(ip+3)]
-			? ip+5 : *ip;
-		NEXT
-
-	OP_NEQ_VV:
-		ip = *(int*)*(ip+1) != *(int*)*(ip+2)
-			? ip+3 : *ip;
-		NEXT
-
-	OP_NEQ_VA:
-		ip = *(int*)*(ip+1) != ((Array)*(ip+3))[*(int*)*(ip+2)]
-			? ip+4 : *ip;
-		NEXT
-
-	OP_NEQ_AA:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] != ((Array)*(ip+4))[*(int*)*(ip+3)]
-			? ip+5 : *ip;
-		NEXT
-
-	OP_LE_VV:
-		ip = *(int*)*(ip+1) <= *(int*)*(ip+2)
-			? ip+3 : *ip;
-		NEXT
-
-	OP_LE_VA:
-		ip = *(int*)*(ip+1) <= ((Array)*(ip+3))[*(int*)*(ip+2)]
-			? ip+4 : *ip;
-		NEXT
-
-	OP_LE_AV:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] <= *(int*)*(ip+3)
-			? ip+4 : *ip;
-		NEXT
-
-	OP_LE_AA:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] <= ((Array)*(ip+4))[*(int*)*(ip+3)]
-			? ip+5 : *ip;
-		NEXT
-
-	OP_LT_VV:
-		ip = *(int*)*(ip+1) < *(int*)*(ip+2)
-			? ip+3 : *ip;
-		NEXT
-
-	OP_LT_VA:
-		ip = *(int*)*(ip+1) < ((Array)*(ip+3))[*(int*)*(ip+2)]
-			? ip+4 : *ip;
-		NEXT
-
-	OP_LT_AV:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] < *(int*)*(ip+3)
-			? ip+4 : *ip;
-		NEXT
-
-	OP_LT_AA:
-		ip = ((Array)*(ip+2))[*(int*)*(ip+1)] < ((Array)*(ip+4))[*(int*)*(ip+3)]
-			? ip+5 : *ip;
-		NEXT
-
-
-	//////////////////////////////
-
-	OP_MUL:
-		reg1 = reg1 * reg2;
-		NEXT
-
-	OP_DIV:
-		reg1 = reg1 / reg2;
-		NEXT
-
-	OP_MOD:
-		reg1 = reg1 % reg2;
-		NEXT
-
-	OP_NEW: {
-		int* old_array = *ip;
-		parser_free(old_array - 1, runtime);	// we always have a placeholder memory reserved
-		int* new_array = parser_alloc(reg1+1, runtime);
-		new_array[0] = reg1;				// we store the size in the first element
-		new_array++;						// and point to the second element
-		for(int i = 0; i < thread_n; i++)	// replace all occurrences of old_array in the thread table
-			if(thread[i] == old_array)
-				thread[i] = new_array;
-		ip++;
-		NEXT
+	void** ip = start;					// pointer to _next_ instruction
+
+	// the callers clear it when the run returns
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wdangling-pointer"
+	PUBLISH_IP();
+	#pragma GCC diagnostic pop
+
+	#if defined(INTERPRETER_DISPATCH_SWITCH)
+	intptr_t opcode;
+	next:
+	opcode = (intptr_t)*ip++;
+	dispatch:
+	switch(opcode) {
+		#include "handlers.h"
+		default: __builtin_unreachable();
 	}
+	#else
+	NEXT
+	#include "handlers.h"
+	#endif
+}
+
+#endif
 
-	OP_FREE: {
-		int* old_array = *ip;
-		parser_free(old_array - 1, runtime);
-		int* new_array = parser_alloc(1, runtime); // we create a placeholder empty array
-		new_array[0] = 0;					// we store the size in the first element
-		new_array++;						// and point to the second element
-		for(int i = 0; i < thread_n; i++)	// replace all occurrences of old_array in the thread table
-			if(thread[i] == old_array)
-				thread[i] = new_array;
-		ip++;
-		NEXT
+void** interpreter_labels(void) {
+	return run(NULL, NULL, NULL);
+}
+
+// the first instructions of the basic blocks: the first one, the jump targets and the
+// ones after jumps. The other instructions run as many times as their block's first.
+static bool* find_leaders(Bytecode bytecode) {
+	bool* leaders = calloc(bytecode->word_n, sizeof(*leaders));
+	bool after_jump = true;
+	for(int i = 0; i < bytecode->word_n; i++) {
+		int value = WORD_VALUE(bytecode->words[i]);
+		if(WORD_TAG(bytecode->words[i]) == TAG_OPCODE) {
+			leaders[i] |= after_jump;
+			after_jump = is_jump(value);
+		} else if(WORD_TAG(bytecode->words[i]) == TAG_JUMP && i + value < bytecode->word_n) {
+			leaders[i + value] = true;
+		}
 	}
+	return leaders;
+}
 
-	OP_SIZE:
-		reg1 = ((Array)*ip++)[-1];
-		NEXT
+static void profile_alloc(Runtime runtime) {
+	runtime->profile = true;
+	runtime->exec_count = calloc(runtime->thread_n, sizeof(*runtime->exec_count));
+	if(runtime->profile_targets == NULL)
+		runtime->profile_targets = calloc(runtime->thread_n, sizeof(*runtime->profile_targets));
+	if(runtime->profile_blocks)
+		runtime->leaders = find_leaders(runtime->bytecode);
+}
 
-	OP_WRITE:
-		printf("%d ", reg1);
-		NEXT
+// the thread entry of the instruction opcode at thread position pos
+static void* relocate_opcode(Runtime runtime, int pos, Opcode opcode, void** labels) {
+	if(runtime->counters != NULL && counters_boundary(runtime->counters, pos)) {
+		runtime->profile_targets[pos] = labels[opcode];
+		return labels[OP_COUNTERS];		// counts the execution too, when profiling
+	}
+	if(!runtime->profile || (runtime->profile_blocks && !runtime->leaders[pos]))
+		return labels[opcode];
+	runtime->profile_targets[pos] = labels[opcode];
+	return labels[OP_PROFILED];
+}
 
-	OP_WRITELN:
-		printf("%d\n", reg1);
-		NEXT
 
-	OP_READ: {
-		int temp;
-		if(!scanf("%d", &temp))
-			return;
-		reg1 = temp;
-		NEXT
+// Parallel loops ////////////////////////////////////////////////////////////////////
+//
+// The iteration range of the loop is split in consecutive chunks, one per worker. Each
+// worker runtime executes the loop's code on a copy of the frame (so the scalars are
+// private) and the shared arrays, stopping at the end of the loop (OP_INTERRUPT there).
+// Afterwards the frame of the last worker, which executed the last iterations, becomes
+// the frame of the runtime and the reductions are combined.
+
+typedef struct pool_worker {
+	struct pool* pool;
+	Runtime runtime;
+	pthread_t thread;
+	void** start;			// the loop in the worker's thread
+	char* out;				// output of the current loop, written by the runtime in order
+	int out_n, out_size;
+	RunStatus status;		// of the current loop, RUN_INTERRUPTED if it reached the end
+}* PoolWorker;
+
+typedef struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	int generation;			// incremented for each loop
+	int active_n;			// workers taking part in the current loop
+	int pending;			// threads still running it
+	bool quit;
+	int worker_n;
+	struct pool_worker* workers;	// workers[0] runs in the calling thread
+}* Pool;
+
+static void pool_write(void* data, const char* buf, int len) {
+	PoolWorker worker = data;
+	if(worker->out_n + len > worker->out_size) {
+		worker->out_size = 2 * (worker->out_n + len);
+		worker->out = realloc(worker->out, worker->out_size);
 	}
+	memcpy(worker->out + worker->out_n, buf, len);
+	worker->out_n += len;
+}
 
-	OP_RAND:
-		reg1 = rand();
-		NEXT
+static void* pool_main(void* arg) {
+	PoolWorker worker = arg;
+	Pool pool = worker->pool;
+	int id = worker - pool->workers;
+	int generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while(true) {
+		while(!pool->quit && pool->generation == generation)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if(pool->quit)
+			break;
+		generation = pool->generation;
+		if(id >= pool->active_n)
+			continue;
+
+		pthread_mutex_unlock(&pool->lock);
+		run(worker->runtime, worker->start, &worker->status);
+		interpreter_ip = NULL;
+		pthread_mutex_lock(&pool->lock);
+
+		if(--pool->pending == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
 
-	OP_HALT:
-		#ifdef PROFILE
-		print_code(runtime->code);
-		map_destroy(thread_to_instr);
-		#endif
-		free(thread);
-		return;
-}
\ No newline at end of file
+static Pool pool_create(Runtime runtime) {
+	Pool pool = calloc(1, sizeof(*pool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->worker_n = runtime->parallel_n;
+	pool->workers = calloc(pool->worker_n, sizeof(*pool->workers));
+
+	for(int i = 0; i < pool->worker_n; i++) {
+		PoolWorker worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->runtime = interpreter_create_runtime(runtime->bytecode, (IO){ .write = pool_write, .data = worker }, 1);
+		worker->runtime->prefetch = runtime->prefetch;
+		worker->runtime->profile_blocks = runtime->profile_blocks;
+		if(runtime->profile)
+			profile_alloc(worker->runtime);
+	}
+	for(int i = 1; i < pool->worker_n; i++)
+		pthread_create(&pool->workers[i].thread, NULL, pool_main, &pool->workers[i]);
+	return pool;
+}
+
+static void pool_destroy(Pool pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(int i = 1; i < pool->worker_n; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	for(int i = 0; i < pool->worker_n; i++) {
+		interpreter_destroy_runtime(pool->workers[i].runtime);
+		free(pool->workers[i].out);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool);
+}
+
+// The OP_REDUCE_* at p, or 0. The opcode is found in the bytecode, the thread has the entries.
+static Opcode is_reduction(Runtime runtime, void** p) {
+	Word word = runtime->bytecode->words[p - runtime->thread];
+	return WORD_TAG(word) == TAG_OPCODE && (WORD_VALUE(word) == OP_REDUCE_ADD || WORD_VALUE(word) == OP_REDUCE_MUL) ? WORD_VALUE(word) : 0;
+}
+
+// Prepares worker to run iterations [lo, hi) of the loop at thread positions [start, end)
+static void prepare_worker(Runtime runtime, PoolWorker worker, int start, int end, void** ip, long long lo, long long hi) {
+	Runtime wr = worker->runtime;
+	Bytecode bytecode = runtime->bytecode;
+	void** labels = interpreter_labels();
+
+	// relocate the loop, arrays are the runtime's current ones
+	for(int i = start; i < end; i++) {
+		int value = WORD_VALUE(bytecode->words[i]);
+		switch(WORD_TAG(bytecode->words[i])) {
+			case TAG_OPCODE: wr->thread[i] = relocate_opcode(wr, i, value, labels);	break;
+			case TAG_JUMP:   wr->thread[i] = &wr->thread[i + value];	break;
+			case TAG_VAR:    wr->thread[i] = &wr->frame[value];		break;
+			case TAG_ARRAY:  wr->thread[i] = runtime->thread[i];		break;
+		}
+	}
+	wr->thread[end] = labels[OP_INTERRUPT];
+	worker->start = &wr->thread[start];
+	worker->out_n = 0;
+
+	// private frame, counter from lo, bound copy hi (minus 1 for <=), reductions from their identity
+	memcpy(wr->frame, runtime->frame, bytecode->var_n * sizeof(*wr->frame));
+	wr->frame[(int*)ip[1] - runtime->frame] = lo;
+	wr->frame[(int*)ip[3] - runtime->frame] = hi - *(int*)ip[4];
+	for(void** p = ip + 5; is_reduction(runtime, p); p += 2)
+		wr->frame[(int*)p[1] - runtime->frame] = is_reduction(runtime, p) == OP_REDUCE_MUL ? 1 : 0;
+}
+
+// Runs the loop following the OP_PARALLEL at ip-1, returns false if it should run sequentially.
+// status is RUN_OK, or the error that stopped a worker (the run should stop with it).
+static bool run_parallel(Runtime runtime, void** ip, RunStatus* status) {
+	long long lo = *(int*)ip[1];
+	long long hi = *(int*)ip[2] + (long long)*(int*)ip[4];		// exclusive
+	long long count = hi - lo;
+	if(count < 2)
+		return false;
+
+	if(runtime->pool == NULL)
+		__atomic_store_n(&runtime->pool, pool_create(runtime), __ATOMIC_RELEASE);	// interpreter_position can read it
+	Pool pool = runtime->pool;
+	int worker_n = count < pool->worker_n ? count : pool->worker_n;
+
+	// the loop starts after the reductions, and ends at the target of OP_PARALLEL
+	void** loop = ip + 5;
+	while(is_reduction(runtime, loop))
+		loop += 2;
+	int start = loop - runtime->thread;
+	int end = (void**)*ip - runtime->thread;
+
+	for(int i = 0; i < worker_n; i++)
+		prepare_worker(runtime, &pool->workers[i], start, end, ip, lo + count * i / worker_n, lo + count * (i + 1) / worker_n);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->active_n = worker_n;
+	pool->pending = worker_n - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	run(pool->workers[0].runtime, pool->workers[0].start, &pool->workers[0].status);
+
+	pthread_mutex_lock(&pool->lock);
+	while(pool->pending > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	// output in the order of the iterations, up to the first worker that stopped with an error
+	flush_output(runtime);
+	*status = RUN_OK;
+	for(int i = 0; i < worker_n && *status == RUN_OK; i++) {
+		if(pool->workers[i].out_n > 0)
+			write_output(runtime, pool->workers[i].out, pool->workers[i].out_n);
+		if(pool->workers[i].status != RUN_INTERRUPTED)
+			*status = pool->workers[i].status;
+	}
+	if(*status != RUN_OK)
+		return true;
+
+	// combine the reductions with their values before the loop
+	int var_n = runtime->bytecode->var_n;
+	int* values = malloc(var_n * sizeof(*values));
+	memcpy(values, pool->workers[worker_n - 1].runtime->frame, var_n * sizeof(*values));
+	for(void** p = ip + 5; p < loop; p += 2) {
+		int var = (int*)p[1] - runtime->frame;
+		bool mul = is_reduction(runtime, p) == OP_REDUCE_MUL;
+		values[var] = runtime->frame[var];
+		for(int i = 0; i < worker_n; i++) {
+			unsigned int x = pool->workers[i].runtime->frame[var];		// wraps around like the loop would
+			values[var] = mul ? (unsigned int)values[var] * x : (unsigned int)values[var] + x;
+		}
+	}
+	memcpy(runtime->frame, values, var_n * sizeof(*values));
+	free(values);
+
+	if(runtime->profile)
+		for(int i = 0; i < worker_n; i++)
+			for(int j = start; j < end; j++) {
+				runtime->exec_count[j] += pool->workers[i].runtime->exec_count[j];
+				pool->workers[i].runtime->exec_count[j] = 0;
+			}
+	return true;
+}
+
+static void stdio_write(void* data, const char* buf, int len) {
+	fwrite(buf, 1, len, stdout);
+}
+
+// like scanf("%d") repeated n times, without parsing the format and locking stdin each time
+static int stdio_read_n(void* data, int* values, int n) {
+	flockfile(stdin);
+	int k = 0;
+	for(; k < n; k++) {
+		int c;
+		do
+			c = getc_unlocked(stdin);
+		while(isspace(c));
+
+		bool negative = c == '-';
+		if(c == '-' || c == '+')
+			c = getc_unlocked(stdin);
+		if(!isdigit(c)) {
+			ungetc(c, stdin);
+			break;
+		}
+
+		unsigned int u = 0;
+		for(; isdigit(c); c = getc_unlocked(stdin))
+			u = u * 10 + (c - '0');
+		ungetc(c, stdin);
+		values[k] = negative ? -u : u;
+	}
+	funlockfile(stdin);
+	return k;
+}
+
+static bool stdio_read(void* data, int* value) {
+	return stdio_read_n(data, value, 1) == 1;
+}
+
+IO interpreter_stdio(void) {
+	return (IO){ .write = stdio_write, .read = stdio_read, .read_n = stdio_read_n, .data = NULL };
+}
+
+Runtime interpreter_create_runtime(Bytecode bytecode, IO io, uint64_t seed) {
+	Runtime runtime = calloc(1, sizeof(*runtime));
+	runtime->bytecode = bytecode;
+	runtime->io = io;
+	runtime->rand_state = seed != 0 ? seed : 1;		// xorshift state must be non-zero
+	runtime->thread_n = bytecode->word_n;
+	runtime->thread = malloc(bytecode->word_n * sizeof(*runtime->thread));
+	runtime->frame = malloc(bytecode->var_n * sizeof(*runtime->frame));
+	runtime->placeholders = malloc(2 * bytecode->array_n * sizeof(*runtime->placeholders));
+	runtime->allocs = set_create(compare_pointers, free);
+	runtime->huge_allocs = set_create(compare_pointers, unmap_huge);
+	runtime->huge_threshold = INTERPRETER_HUGE_THRESHOLD;
+	runtime->prefetch = INTERPRETER_PREFETCH;
+	return runtime;
+}
+
+void interpreter_reset(Runtime runtime, int arg_n, String args[]) {
+	Bytecode bytecode = runtime->bytecode;
+
+	// free all arrays of the previous run
+	set_destroy(runtime->allocs);
+	set_destroy(runtime->huge_allocs);
+	runtime->allocs = set_create(compare_pointers, free);
+	runtime->huge_allocs = set_create(compare_pointers, unmap_huge);
+	runtime->memory_used = 0;
+	runtime->huge_n = runtime->hugetlb_n = 0;
+	runtime->huge_bytes = 0;
+	runtime->out_n = 0;
+	runtime->memory_peak = 0;
+	runtime->output_bytes = 0;
+	runtime->new_n = runtime->free_n = 0;
+	runtime->patch_time = 0;
+
+	memcpy(runtime->frame, bytecode->values, bytecode->var_n * sizeof(*runtime->frame));
+
+	// the counts are of the last run
+	if(runtime->profile && runtime->exec_count == NULL)
+		profile_alloc(runtime);
+	if(runtime->exec_count != NULL)
+		memset(runtime->exec_count, 0, bytecode->word_n * sizeof(*runtime->exec_count));
+	if(runtime->counters != NULL && runtime->profile_targets == NULL)
+		runtime->profile_targets = calloc(runtime->thread_n, sizeof(*runtime->profile_targets));
+
+	// all arrays start as empty placeholders (2 ints each, size and a dummy element)
+	memset(runtime->placeholders, 0, 2 * bytecode->array_n * sizeof(*runtime->placeholders));
+
+	// "!args" array containing all arguments
+	Array args_array = alloc_ints(arg_n + 2, runtime) + 1;
+	args_array[-1] = arg_n;
+	for(int i = 0; i < arg_n; i++)
+		args_array[i+1] = atoi(args[i]);		// i+1 cause argument command is 1-based
+
+	// single relocation pass from the position-independent words to the thread
+	void** labels = interpreter_labels();
+	void** thread = runtime->thread;
+	Word* words = bytecode->words;
+	for(int i = 0; i < bytecode->word_n; i++) {
+		int value = WORD_VALUE(words[i]);
+		switch(WORD_TAG(words[i])) {
+			case TAG_OPCODE: thread[i] = relocate_opcode(runtime, i, value, labels);	break;
+			case TAG_JUMP:   thread[i] = &thread[i + value];		break;
+			case TAG_VAR:    thread[i] = &runtime->frame[value];	break;
+			case TAG_ARRAY:
+				thread[i] = value == bytecode->args_array ? args_array : &runtime->placeholders[2 * value + 1];
+				break;
+		}
+	}
+}
+
+RunStatus interpreter_run(Runtime runtime) {
+	RunStatus status;
+	if(runtime->counters != NULL)
+		counters_start(runtime->counters, 0);
+	run(runtime, runtime->thread, &status);
+	interpreter_ip = NULL;
+	if(runtime->counters != NULL)
+		counters_finish(runtime->counters);
+	return status;
+}
+
+void interpreter_interrupt(Runtime runtime) {
+	void* interrupt = interpreter_labels()[OP_INTERRUPT];
+	Word* words = runtime->bytecode->words;
+	for(int i = 0; i < runtime->thread_n; i++)
+		if(WORD_TAG(words[i]) == TAG_OPCODE)
+			__atomic_store_n(&runtime->thread[i], interrupt, __ATOMIC_RELAXED);
+}
+
+uint64_t interpreter_dispatches(Runtime runtime) {
+	Word* words = runtime->bytecode->words;
+	uint64_t dispatches = 0, block_count = 0;
+	for(int i = 0; i < runtime->thread_n; i++) {
+		if(WORD_TAG(words[i]) != TAG_OPCODE)
+			continue;
+		if(!runtime->profile_blocks || runtime->leaders[i])
+			block_count = runtime->exec_count[i];
+		dispatches += block_count;
+	}
+	return dispatches;
+}
+
+String interpreter_status_message(RunStatus status) {
+	switch(status) {
+		case RUN_NO_INPUT:			return "invalid input";
+		case RUN_INTERRUPTED:		return "interrupted";
+		case RUN_OUT_OF_MEMORY:		return "memory limit exceeded";
+		case RUN_SIZE_MISMATCH:		return "array sizes differ";
+		case RUN_DIVISION_ERROR:	return "division by zero or overflow";
+		default:					return "";
+	}
+}
+
+bool interpreter_position(Runtime runtime, const void* p, int* pos) {
+	if((const void**)p >= (const void**)runtime->thread && (const void**)p <= (const void**)runtime->thread + runtime->thread_n) {
+		*pos = (const void**)p - (const void**)runtime->thread;
+		return true;
+	}
+
+	// the workers of the parallel loops have their own threads
+	Pool pool = __atomic_load_n(&runtime->pool, __ATOMIC_ACQUIRE);
+	for(int i = 0; pool != NULL && i < pool->worker_n; i++)
+		if(interpreter_position(pool->workers[i].runtime, p, pos))
+			return true;
+	return false;
+}
+
+void interpreter_destroy_runtime(Runtime runtime) {
+	if(runtime->pool != NULL)
+		pool_destroy(runtime->pool);
+	set_destroy(runtime->allocs);
+	set_destroy(runtime->huge_allocs);
+	free(runtime->thread);
+	free(runtime->frame);
+	free(runtime->placeholders);
+	free(runtime->exec_count);
+	free(runtime->leaders);
+	free(runtime->profile_targets);
+	free(runtime);
+}
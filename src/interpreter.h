@@ -1,6 +1,74 @@
 
+#pragma once
 
 #include "parser.h"
 
+typedef enum {
+	RUN_OK,				// the program finished
+	RUN_NO_INPUT,		// stopped because a read failed
+	RUN_INTERRUPTED,	// stopped by interpreter_interrupt
+	RUN_OUT_OF_MEMORY,	// stopped because a new exceeded runtime->memory_limit
+	RUN_SIZE_MISMATCH,	// stopped because the arrays of a whole-array operation had different sizes
+	RUN_DIVISION_ERROR,	// stopped by a division (or %) by zero, or of INT_MIN by -1
+} RunStatus;
 
-void interpreter_run(Runtime runtime);
+// Default runtime->prefetch, in iterations
+#define INTERPRETER_PREFETCH 16
+
+// Default runtime->huge_threshold, in bytes
+#define INTERPRETER_HUGE_THRESHOLD (32 << 20)
+
+// Returns the table of thread entries, indexed by Opcode: the handlers' addresses, opcodes
+// or functions, depending on the dispatch backend (see interpreter.c). labels[OP_COUNT] is
+// the profiling entry, that counts the instruction and then executes it, labels[OP_COUNT + 1]
+// the entry that notifies runtime->counters and then executes it.
+void** interpreter_labels(void);
+
+// IO through stdin/stdout
+IO interpreter_stdio(void);
+
+// Creates an instance of bytecode with its own memory. Many runtimes can share the
+// same bytecode (which should outlive them), and each can run it many times.
+Runtime interpreter_create_runtime(Bytecode bytecode, IO io, uint64_t seed);
+
+// Resets the memory to its initial state and sets the program's arguments.
+// Must be called before each interpreter_run.
+void interpreter_reset(Runtime runtime, int arg_n, String args[]);
+
+RunStatus interpreter_run(Runtime runtime);
+
+// Makes a running interpreter_run stop (with RUN_INTERRUPTED) at its next instruction,
+// by pointing all instructions of the thread to OP_INTERRUPT. Can be called from
+// another thread, the runtime should be reset before running again.
+void interpreter_interrupt(Runtime runtime);
+
+// The instructions executed by the last run, from the counts of a profiled run. With
+// runtime->profile_blocks the count of each block's first instruction is used for the
+// whole block, so the result is exact unless the run stopped in the middle of a block.
+uint64_t interpreter_dispatches(Runtime runtime);
+
+// The message for a run that stopped with status (other than RUN_OK), eg "invalid input"
+String interpreter_status_message(RunStatus status);
+
+void interpreter_destroy_runtime(Runtime runtime);
+
+// Points to the ip of the run executing in the calling thread (NULL if none), so that a
+// sampling profiler can read it from a signal handler. ip points to the word after the
+// opcode while an instruction executes. The run keeps ip in memory anyway (it is live
+// across too many handlers for a register), so publishing it costs nothing. The tail-call
+// backend keeps ip in a register and does not publish it, interpreter_ip stays NULL.
+extern __thread void*** interpreter_ip;
+
+// Finds the thread position pointed by p (eg an ip recovered by a sampling profiler), in the
+// thread of runtime or of its parallel workers. p can be the end of the thread. Takes no
+// locks, so it can be called from a signal handler.
+bool interpreter_position(Runtime runtime, const void* p, int* pos);
+
+// eg "OP_ADD_VVV"
+String interpreter_opcode_name(Opcode opcode);
+
+// Prints the instruction at thread position pos, with the names of its operands and its
+// jumps' target positions, eg "OP_ADD_VVA s s a[] i"
+void print_instruction(Bytecode bytecode, int pos, FILE* out);
+
+void print_code(Bytecode bytecode, uint64_t* exec_count, FILE* out);
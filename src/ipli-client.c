@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "parser.h"
+#include "interpreter.h"
+#include "protocol.h"
+#include "server.h"
+
+// Same command line as ipli-fast, but the program runs in an ipli-fast --server.
+// The socket is --server SOCKET, or $IPLI_SOCKET (default SERVER_SOCKET). The limits
+// of the run (which can only lower the server's) are --time-limit and --memory-limit,
+// or $IPLI_TIME_LIMIT (secs) and $IPLI_MEMORY_LIMIT (MB). The options that only affect
+// a local run are accepted and ignored, with a warning.
+
+// ipli-fast options that do not apply to a run in the server, and whether they take an argument
+static const struct { String name; bool has_arg; } local_options[] = {
+	{ "-p", true }, { "--prefetch", true }, { "--huge-pages", true }, { "--hugetlb", false },
+	{ "--huge-report", false }, { "--profile", false }, { "--sample", true }, { "--folded", true },
+	{ "--annotate", false }, { "--annotate-json", false }, { "--counters", false }, { "--stats", false },
+	{ "--batch", true }, { "-j", true }, { "--cache-size", true },
+};
+
+// max values in a MSG_INPUT
+#define INPUT_BATCH (1 << 16)
+
+// stdin, read directly so that the values already available can be sent without blocking
+static struct {
+	char buf[1 << 16];
+	int pos, len;
+	bool eof;
+} input;
+
+// Reads more of stdin, without blocking if !block. Returns false if nothing was read.
+static bool input_fill(bool block) {
+	struct pollfd ready = { .fd = STDIN_FILENO, .events = POLLIN };
+	if(input.eof || (!block && poll(&ready, 1, 0) != 1))
+		return false;
+
+	memmove(input.buf, input.buf + input.pos, input.len - input.pos);
+	input.len -= input.pos;
+	input.pos = 0;
+	if(input.len == sizeof(input.buf))
+		return false;		// a token longer than the buffer
+
+	ssize_t n = read(STDIN_FILENO, input.buf + input.len, sizeof(input.buf) - input.len);
+	if(n <= 0) {
+		input.eof = true;
+		return false;
+	}
+	input.len += n;
+	return true;
+}
+
+// Like scanf("%d"), returns 1 if a value was read, 0 if stdin ended or is not a number,
+// -1 if the value is not available yet (only if !block)
+static int input_int(int32_t* value, bool block) {
+	while(true) {
+		int i = input.pos;
+		while(i < input.len && isspace((unsigned char)input.buf[i]))
+			i++;
+		input.pos = i;
+
+		// the token is complete if something follows it
+		if(i < input.len && (input.buf[i] == '-' || input.buf[i] == '+'))
+			i++;
+		int digits = i;
+		while(i < input.len && isdigit((unsigned char)input.buf[i]))
+			i++;
+		if(i < input.len || input.eof) {
+			if(i == digits)
+				return 0;
+
+			unsigned int u = 0;
+			for(int k = digits; k < i; k++)
+				u = u * 10 + (input.buf[k] - '0');
+			*value = input.buf[input.pos] == '-' ? -u : u;
+			input.pos = i;
+			return 1;
+		}
+
+		if(!input_fill(block) && !input.eof)
+			return block ? 0 : -1;
+	}
+}
+
+static int connect_server(String path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		perror(path);
+		return -1;
+	}
+	return fd;
+}
+
+// index in local_options, or -1
+static int find_local_option(String arg) {
+	for(int i = 0; i < (int)(sizeof(local_options) / sizeof(*local_options)); i++)
+		if(strcmp(arg, local_options[i].name) == 0)
+			return i;
+	return -1;
+}
+
+int main(int argc, char* argv[]) {
+	int first_arg = 1;
+	bool verbose = false;
+	String socket_path = getenv("IPLI_SOCKET") ? getenv("IPLI_SOCKET") : SERVER_SOCKET;
+	uint32_t time_limit_ms = getenv("IPLI_TIME_LIMIT") ? atof(getenv("IPLI_TIME_LIMIT")) * 1000 : 0;
+	uint32_t memory_limit_mb = getenv("IPLI_MEMORY_LIMIT") ? atoi(getenv("IPLI_MEMORY_LIMIT")) : 0;
+	for(; first_arg < argc && argv[first_arg][0] == '-'; first_arg++) {
+		int local = find_local_option(argv[first_arg]);
+		if(strcmp(argv[first_arg], "-v") == 0)
+			verbose = true;
+		else if(strcmp(argv[first_arg], "-c") == 0)
+			;		// the server always caches
+		else if(strcmp(argv[first_arg], "--server") == 0 && first_arg + 1 < argc)
+			socket_path = argv[++first_arg];
+		else if(strcmp(argv[first_arg], "--time-limit") == 0 && first_arg + 1 < argc)
+			time_limit_ms = atof(argv[++first_arg]) * 1000;
+		else if(strcmp(argv[first_arg], "--memory-limit") == 0 && first_arg + 1 < argc)
+			memory_limit_mb = atoi(argv[++first_arg]);
+		else if(local != -1 && (!local_options[local].has_arg || first_arg + 1 < argc)) {
+			fprintf(stderr, "ipli-client: %s is ignored, the program runs in the server\n", argv[first_arg]);
+			first_arg += local_options[local].has_arg;
+		} else
+			break;
+	}
+
+	if(first_arg >= argc) {
+		fprintf(stderr, "usage: ipli-client [-v] [-c] [--server SOCKET] [--time-limit SECS] [--memory-limit MB] [ipli-fast options] FILE\n");
+		fprintf(stderr, "  -v       print the bytecode\n");
+		fprintf(stderr, "  -c       accepted for compatibility, the server always caches the compiled programs\n");
+		fprintf(stderr, "  --server the server's Unix socket (default $IPLI_SOCKET, or %s)\n", SERVER_SOCKET);
+		fprintf(stderr, "  --time-limit  ask for a lower time limit than the server's (default $IPLI_TIME_LIMIT)\n");
+		fprintf(stderr, "  --memory-limit  ask for a lower memory limit than the server's (default $IPLI_MEMORY_LIMIT)\n");
+		fprintf(stderr, "  the other ipli-fast options (-p, --profile, --stats, --batch, ...) only affect local\n");
+		fprintf(stderr, "  runs, they are ignored with a warning\n");
+		return -1;
+	}
+
+	// read source
+	FILE* file = fopen(argv[first_arg], "r");
+	if(!file) {
+		fprintf(stderr, "invalid file\n");
+		return -1;
+	}
+	Vector source = vector_create(0, free);
+	char* line = NULL;
+	size_t line_size = 0;
+	while(getline(&line, &line_size, file) != -1)
+		vector_insert_last(source, strdup(line));
+	free(line);
+	fclose(file);
+
+	if(verbose) {
+		char error[PARSER_ERROR_SIZE];
+		Bytecode bytecode = parser_compile(source, false, error);
+		if(bytecode != NULL) {
+			print_code(bytecode, NULL, stdout);
+			parser_destroy_bytecode(bytecode);
+		}
+	}
+
+	// request: header followed by the NUL-terminated arguments
+	RequestHeader header = {
+		.source_hash = parser_source_hash(source),
+		.time_limit_ms = time_limit_ms,
+		.memory_limit_mb = memory_limit_mb,
+	};
+	size_t request_size = sizeof(header);
+	for(int i = first_arg + 1; i < argc; i++)
+		request_size += strlen(argv[i]) + 1;
+
+	char* request = malloc(request_size);
+	memcpy(request, &header, sizeof(header));
+	char* p = request + sizeof(header);
+	for(int i = first_arg + 1; i < argc; i++)
+		p = stpcpy(p, argv[i]) + 1;
+
+	int fd = connect_server(socket_path);
+	if(fd == -1 || !protocol_send(fd, MSG_REQUEST, request, request_size))
+		return -1;
+	free(request);
+
+	// serve the server's messages until MSG_EXIT
+	int code = -1;
+	MessageType type;
+	char* data;
+	uint32_t size;
+	while(code == -1 && protocol_receive(fd, &type, &data, &size)) {
+		switch(type) {
+			case MSG_NEED_SOURCE: {
+				size_t total = 0;
+				for(int i = 0; i < vector_size(source); i++)
+					total += strlen(vector_get_at(source, i));
+				char* text = malloc(total + 1);
+				char* end = text;
+				for(int i = 0; i < vector_size(source); i++)
+					end = stpcpy(end, vector_get_at(source, i));
+				protocol_send(fd, MSG_SOURCE, text, total);
+				free(text);
+				break;
+			}
+			case MSG_OUTPUT:
+				fwrite(data, 1, size, stdout);
+				break;
+			case MSG_NEED_INPUT: {
+				// the values that the program needs now (waiting for them), then the ones
+				// already available
+				uint32_t wanted = 1;
+				if(size == sizeof(wanted))
+					memcpy(&wanted, data, sizeof(wanted));
+				fflush(stdout);
+
+				int32_t* values = malloc(INPUT_BATCH * sizeof(*values));
+				int value_n = 0;
+				while(value_n < INPUT_BATCH && input_int(&values[value_n], value_n < wanted) == 1)
+					value_n++;
+				if(value_n > 0)
+					protocol_send(fd, MSG_INPUT, values, value_n * sizeof(*values));
+				else
+					protocol_send(fd, MSG_NO_INPUT, NULL, 0);
+				free(values);
+				break;
+			}
+			case MSG_EXIT:
+				memcpy(&code, data, sizeof(int32_t));
+				fflush(stdout);		// the output comes before the message
+				if(size > sizeof(int32_t))		// compile errors go to stdout like in ipli-fast
+					fprintf(code == 1 ? stdout : stderr, "%s\n", data + sizeof(int32_t));
+				break;
+			default:
+				break;
+		}
+		free(data);
+	}
+	if(code == -1)
+		fprintf(stderr, "connection to the server lost\n");
+
+	close(fd);
+	vector_destroy(source);
+	return code;
+}
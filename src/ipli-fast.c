@@ -2,26 +2,157 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include "parser.h"
 #include "interpreter.h"
+#include "cache.h"
+#include "batch.h"
+#include "server.h"
+#include "sampler.h"
+#include "report.h"
+#include "counters.h"
 
-int main(int argc, char* argv[]) {
-	srand(time(NULL));
+// Times of the phases outside parser_compile, in seconds
+typedef struct {
+	double load, cache_load, threading, run;
+} MainTimes;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// prints the --stats JSON object: the time of each phase, the size of the thread and the
+// statistics of the run. The dispatches are counted per basic block, which costs little,
+// unless the run is fully profiled anyway (--profile, --annotate).
+static void print_stats(Bytecode bytecode, Runtime runtime, RunStatus status, int line_n, size_t source_bytes, bool cached, MainTimes times, FILE* out) {
+	static const String status_names[] = { "ok", "no_input", "interrupted", "out_of_memory", "size_mismatch", "division_error" };
+	CompileTimes compile = bytecode->compile_times;
+
+	int instruction_n = 0;
+	for(int i = 0; i < bytecode->word_n; i++)
+		instruction_n += WORD_TAG(bytecode->words[i]) == TAG_OPCODE;
 
+	fprintf(out, "{\"source\": {\"lines\": %d, \"bytes\": %zu}, \"cached\": %s,\n", line_n, source_bytes, cached ? "true" : "false");
+	fprintf(out, " \"phases\": {\"load\": %.6f, \"cache_load\": %.6f, \"parse\": %.6f, \"parallel\": %.6f, \"idioms\": %.6f,"
+		" \"codegen\": %.6f, \"jumps\": %.6f, \"assemble\": %.6f, \"threading\": %.6f, \"run\": %.6f},\n",
+		times.load, times.cache_load, compile.parse, compile.parallel, compile.idioms,
+		compile.codegen, compile.jumps, compile.assemble, times.threading, times.run);
+	fprintf(out, " \"thread\": {\"words\": %d, \"bytes\": %zu, \"instructions\": %d, \"variables\": %d, \"arrays\": %d},\n",
+		bytecode->word_n, bytecode->word_n * sizeof(void*), instruction_n, bytecode->var_n, bytecode->array_n);
+
+	fprintf(out, " \"run\": {\"status\": \"%s\", \"dispatches\": ", status_names[status]);
+	fprintf(out, "%" PRIu64, interpreter_dispatches(runtime));
+	fprintf(out, ", \"new\": %d, \"free\": %d, \"patch\": %.6f, \"peak_memory\": %zu, \"output_bytes\": %" PRIu64 "}}\n",
+		runtime->new_n, runtime->free_n, runtime->patch_time, runtime->memory_peak, runtime->output_bytes);
+}
+
+int main(int argc, char* argv[]) {
 	int first_arg = 1;
 	bool verbose = false;
-	if(argc > 1 && strcmp(argv[first_arg], "-v") == 0) {
-		verbose = true;
-		first_arg++;
+	bool use_cache = false;
+	String batch_file = NULL;
+	String server_socket = NULL;
+	ServerOptions server_options = { .cache_size = 64 };
+	int thread_n = sysconf(_SC_NPROCESSORS_ONLN);
+	int parallel_n = 0;
+	int prefetch = INTERPRETER_PREFETCH;
+	size_t huge_threshold = INTERPRETER_HUGE_THRESHOLD;
+	bool hugetlb = false;
+	bool huge_report = false;
+	bool profile = false;
+	int sample_hz = 0;
+	String folded_file = NULL;
+	bool annotate = false;
+	bool annotate_json = false;
+	bool loop_counters = false;
+	bool stats = false;
+	for(; first_arg < argc && argv[first_arg][0] == '-'; first_arg++) {
+		if(strcmp(argv[first_arg], "-v") == 0)
+			verbose = true;
+		else if(strcmp(argv[first_arg], "-c") == 0)
+			use_cache = true;
+		else if(strcmp(argv[first_arg], "--batch") == 0 && first_arg + 1 < argc)
+			batch_file = argv[++first_arg];
+		else if(strcmp(argv[first_arg], "-p") == 0 && first_arg + 1 < argc)
+			parallel_n = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--prefetch") == 0 && first_arg + 1 < argc)
+			prefetch = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--huge-pages") == 0 && first_arg + 1 < argc)
+			huge_threshold = (size_t)atoi(argv[++first_arg]) << 20;
+		else if(strcmp(argv[first_arg], "--hugetlb") == 0)
+			hugetlb = true;
+		else if(strcmp(argv[first_arg], "--huge-report") == 0)
+			huge_report = true;
+		else if(strcmp(argv[first_arg], "--profile") == 0)
+			profile = true;
+		else if(strcmp(argv[first_arg], "--sample") == 0 && first_arg + 1 < argc)
+			sample_hz = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--folded") == 0 && first_arg + 1 < argc)
+			folded_file = argv[++first_arg];
+		else if(strcmp(argv[first_arg], "--annotate") == 0)
+			annotate = true;
+		else if(strcmp(argv[first_arg], "--annotate-json") == 0)
+			annotate = annotate_json = true;
+		else if(strcmp(argv[first_arg], "--counters") == 0)
+			loop_counters = true;
+		else if(strcmp(argv[first_arg], "--stats") == 0)
+			stats = true;
+		else if(strcmp(argv[first_arg], "-j") == 0 && first_arg + 1 < argc)
+			thread_n = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--server") == 0 && first_arg + 1 < argc)
+			server_socket = argv[++first_arg];
+		else if(strcmp(argv[first_arg], "--time-limit") == 0 && first_arg + 1 < argc)
+			server_options.time_limit_ms = atof(argv[++first_arg]) * 1000;
+		else if(strcmp(argv[first_arg], "--memory-limit") == 0 && first_arg + 1 < argc)
+			server_options.memory_limit_mb = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--cache-size") == 0 && first_arg + 1 < argc)
+			server_options.cache_size = atoi(argv[++first_arg]);
+		else
+			break;
+	}
+
+	if(server_socket != NULL) {
+		server_options.thread_n = thread_n > 0 ? thread_n : 1;
+		server_run(server_socket, server_options);
+		return -1;
 	}
 
 	if(first_arg >= argc) {
-		fprintf(stderr, "usage: ipli-fast [-v] FILE\n");
+		fprintf(stderr, "usage: ipli-fast [-v] [-c] [-p N] [--prefetch N] [--huge-pages MB] [--hugetlb] [--huge-report] [--profile] [--sample HZ [--folded OUT]] [--annotate[-json]] [--counters] [--stats] [--batch ARGS_FILE [-j N]] FILE\n");
+		fprintf(stderr, "       ipli-fast --server SOCKET [-j N] [--time-limit SECS] [--memory-limit MB] [--cache-size N]\n");
+		fprintf(stderr, "  -c       use FILE.c (eg prog.iplc) as a bytecode cache, it is created if missing or stale\n");
+		fprintf(stderr, "  -p       run the loops whose iterations are independent on N threads\n");
+		fprintf(stderr, "  --prefetch  prefetch strided array accesses N loop iterations ahead (default %d, 0 disables)\n", INTERPRETER_PREFETCH);
+		fprintf(stderr, "  --huge-pages  arrays of at least MB megabytes use huge pages (default %d, 0 disables),\n", INTERPRETER_HUGE_THRESHOLD >> 20);
+		fprintf(stderr, "           transparent ones, or reserved ones with --hugetlb (if available)\n");
+		fprintf(stderr, "  --huge-report  print on stderr how many arrays got huge pages\n");
+		fprintf(stderr, "  --profile  print on stderr the bytecode with the execution count of each instruction\n");
+		fprintf(stderr, "  --sample  sample the running instruction HZ times per cpu second, and print on stderr\n");
+		fprintf(stderr, "           the instructions by samples. --folded writes the samples to OUT as folded\n");
+		fprintf(stderr, "           stacks of the enclosing loops (for flamegraph.pl)\n");
+		fprintf(stderr, "  --annotate  print on stderr the source with the dispatches and time share of each line,\n");
+		fprintf(stderr, "           and its instructions (time from the samples with --sample). --annotate-json as JSON\n");
+		fprintf(stderr, "  --counters  print on stderr the hardware counters (IPC, misses per 1000 instructions)\n");
+		fprintf(stderr, "           of each outermost loop, or its time if perf_event_open is not available\n");
+		fprintf(stderr, "  --stats  print on stderr, as JSON, the time of each compile phase and of the run, the\n");
+		fprintf(stderr, "           thread's size, and the run's dispatches, new/free count, peak memory and output\n");
+		fprintf(stderr, "           bytes. The dispatches are counted per basic block, which slows down the run a bit\n");
+		fprintf(stderr, "  --batch  run FILE once for each line of ARGS_FILE (the line contains the arguments),\n");
+		fprintf(stderr, "           in parallel, the outputs are printed in the order of the lines\n");
+		fprintf(stderr, "  -j       number of threads for --batch and --server (default: number of cpus)\n");
+		fprintf(stderr, "  --server serve the programs sent by ipli-client on the Unix socket SOCKET (eg %s),\n", SERVER_SOCKET);
+		fprintf(stderr, "           keeping the last --cache-size (default 64) compiled programs. The limits\n");
+		fprintf(stderr, "           are the max for each run, clients can ask for lower ones\n");
 		return -1;
 	}
 
 	// read source
+	MainTimes times = { 0 };
+	double start = now();
 	String filename = argv[first_arg];
 	FILE* file = fopen(filename, "r");
 	if(!file) {
@@ -30,25 +161,133 @@ int main(int argc, char* argv[]) {
 	}
 	Vector source = vector_create(0, free);
 
-	int N = 100;
-	char line[N];
-
-	while(fgets(line, N, file) != NULL)
+	// getline, so that deeply indented lines are not split
+	char* line = NULL;
+	size_t line_size = 0;
+	while(getline(&line, &line_size, file) != -1)
 		vector_insert_last(source, strdup(line));
+	free(line);
 	fclose(file);
+	times.load = now() - start;
 
-	// collect args
-	Vector args = vector_create(0, NULL);
-	for(int i = first_arg + 1; i < argc; i++)
-		vector_insert_last(args, argv[i]);
+	int line_n = vector_size(source);
+	size_t source_bytes = 0;
+	for(int i = 0; i < line_n; i++)
+		source_bytes += strlen(vector_get_at(source, i));
 
-	// create program and run
-	Runtime runtime = parser_create_runtime(source, args, verbose);
-	interpreter_run(runtime);
+	// the parser modifies the lines, the report shows them as written
+	Vector report_source = vector_create(0, free);
+	for(int i = 0; annotate && i < vector_size(source); i++)
+		vector_insert_last(report_source, strdup(vector_get_at(source, i)));
 
-	// cleanup
+	// compile (or load from the cache)
+	Bytecode bytecode = NULL;
+	char cache_file[strlen(filename) + 2];
+	if(use_cache) {
+		sprintf(cache_file, "%sc", filename);
+		start = now();
+		bytecode = cache_load(cache_file, parser_source_hash(source));
+		times.cache_load = now() - start;
+		if(bytecode != NULL && bytecode->parallel != (parallel_n > 1)) {
+			parser_destroy_bytecode(bytecode);		// compiled with/without -p
+			bytecode = NULL;
+		}
+	}
+	if(bytecode == NULL) {
+		char error[PARSER_ERROR_SIZE];
+		bytecode = parser_compile(source, parallel_n > 1, error);
+		if(bytecode == NULL) {
+			printf("%s\n", error);
+			vector_destroy(source);
+			vector_destroy(report_source);
+			return 1;
+		}
+		if(use_cache)
+			cache_write(cache_file, bytecode);
+	}
 	vector_destroy(source);
-	vector_destroy(args);
+	bool cached = bytecode->mapping != NULL;
+
+	if(verbose)
+		print_code(bytecode, NULL, stdout);
+
+	if(batch_file != NULL) {
+		int failed_n = batch_run(bytecode, batch_file, thread_n);
+		parser_destroy_bytecode(bytecode);
+		if(failed_n == -1) {
+			fprintf(stderr, "invalid file\n");
+			return -1;
+		}
+		return failed_n == 0 ? 0 : 2;		// like a single run
+	}
+
+	// run
+	Runtime runtime = interpreter_create_runtime(bytecode, interpreter_stdio(), time(NULL));
+	runtime->parallel_n = parallel_n;
+	runtime->prefetch = prefetch;
+	runtime->huge_threshold = huge_threshold;
+	runtime->hugetlb = hugetlb;
+	runtime->profile = profile || annotate || stats;
+	runtime->profile_blocks = !profile && !annotate;		// --stats needs just the total
+	runtime->counters = loop_counters ? counters_create(bytecode) : NULL;
+	start = now();
+	interpreter_reset(runtime, argc - first_arg - 1, argv + first_arg + 1);
+	times.threading = now() - start;
+	if(sample_hz > 0)
+		sampler_start(runtime, sample_hz);
+	start = now();
+	RunStatus status = interpreter_run(runtime);
+	times.run = now() - start;
+	if(sample_hz > 0)
+		sampler_stop();
+	fflush(stdout);		// the output comes before the messages
+	if(status != RUN_OK)
+		fprintf(stderr, "%s\n", interpreter_status_message(status));
+
+	if(profile) {
+		fflush(stdout);
+		print_code(bytecode, runtime->exec_count, stderr);
+	}
+
+	if(annotate) {
+		fflush(stdout);
+		uint64_t unknown;
+		uint64_t* samples = sample_hz > 0 ? sampler_counts(&unknown) : NULL;
+		report_annotate(bytecode, report_source, runtime->exec_count, samples, annotate_json, stderr);
+		free(samples);
+	}
+
+	if(sample_hz > 0) {
+		fflush(stdout);
+		FILE* folded = folded_file != NULL ? fopen(folded_file, "w") : NULL;
+		if(folded_file != NULL && folded == NULL)
+			fprintf(stderr, "cannot write %s\n", folded_file);
+		sampler_report(stderr, folded);
+		if(folded != NULL)
+			fclose(folded);
+	}
+
+	if(loop_counters) {
+		fflush(stdout);
+		counters_report(runtime->counters, stderr);
+		counters_destroy(runtime->counters);
+	}
+
+	if(huge_report) {
+		fflush(stdout);
+		fprintf(stderr, "huge pages: %d arrays, %zu MB (%d with MAP_HUGETLB)\n", runtime->huge_n, runtime->huge_bytes >> 20, runtime->hugetlb_n);
+	}
+
+	if(stats) {
+		fflush(stdout);
+		print_stats(bytecode, runtime, status, line_n, source_bytes, cached, times, stderr);
+	}
+
+	// cleanup
+	vector_destroy(report_source);
+	interpreter_destroy_runtime(runtime);
+	parser_destroy_bytecode(bytecode);
 
-	parser_destroy_runtime(runtime);
-}
\ No newline at end of file
+	// like ipli-client, 2 if the run stopped before the end of the program
+	return status == RUN_OK ? 0 : 2;
+}
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "parser.h"
+#include "interpreter.h"
+#include "counters.h"
+
+// Microbenchmark of single instructions. A statement (given directly, or as the opcode it
+// compiles to) is compiled after a fixed setup, and its instructions are copied COPIES times
+// into a synthetic thread:
+//
+//   setup
+//   loop: statement x COPIES
+//         OP_DEC_V iterations
+//         OP_LE_VV -> loop iterations zero
+//   OP_HALT
+//
+// The thread runs ITERATIONS times around the loop, and so does a baseline with no copies,
+// whose time is subtracted. So the cost of a copy is measured without the loop control or
+// the surrounding program. With two statements they alternate (s1 s2 s1 s2 ...), for the
+// cost of a pair. The operand layout is controlled by the statement itself, eg
+// "a[i] = b[j] + c[k]" touches three arrays, "a[i] = a[i] + a[i]" a single element.
+// The comparisons of the table are false, so the if bodies are never executed.
+
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_COPIES 100
+#define DEFAULT_RUNS 5
+
+// the variables and arrays the statements can use
+static String setup[] = {
+	"new a[1024]",
+	"new b[1024]",
+	"new c[1024]",
+	"i = 1",
+	"j = 2",
+	"k = 3",
+	"v = 4",
+	"w = 5",
+	"x = 5",
+	"y = 7",
+	"z = 9",
+	"b[j] = 4",
+	"c[j] = 4",
+	"c[k] = 6",
+};
+
+// a statement for each opcode (lines separated by ';')
+static struct { String opcode, statement; } statements[] = {
+	{ "OP_ASSIGN_VV",	"x = y" },
+	{ "OP_ASSIGN_VA",	"x = b[j]" },
+	{ "OP_ASSIGN_AV",	"a[i] = y" },
+	{ "OP_ASSIGN_AA",	"a[i] = b[j]" },
+	{ "OP_INC_V",		"x = x + 1" },
+	{ "OP_INC_A",		"a[i] = a[i] + 1" },
+	{ "OP_DEC_V",		"x = x - 1" },
+	{ "OP_DEC_A",		"a[i] = a[i] - 1" },
+	{ "OP_ADD_VVV",		"x = y + z" },
+	{ "OP_ADD_VVA",		"x = y + b[j]" },
+	{ "OP_ADD_VAA",		"x = b[j] + c[k]" },
+	{ "OP_ADD_AVV",		"a[i] = y + z" },
+	{ "OP_ADD_AVA",		"a[i] = y + c[k]" },
+	{ "OP_ADD_AAA",		"a[i] = b[j] + c[k]" },
+	{ "OP_SUB_VVV",		"x = y - z" },
+	{ "OP_SUB_VVA",		"x = y - b[j]" },
+	{ "OP_SUB_VAA",		"x = b[j] - c[k]" },
+	{ "OP_SUB_AVV",		"a[i] = y - z" },
+	{ "OP_SUB_AVA",		"a[i] = y - c[k]" },
+	{ "OP_SUB_AAA",		"a[i] = b[j] - c[k]" },
+	{ "OP_MUL",			"x = y * z" },
+	{ "OP_DIV",			"x = y / z" },
+	{ "OP_MOD",			"x = y % z" },
+	{ "OP_EQ_VV",		"if x == y;\tz = z" },
+	{ "OP_EQ_VA",		"if x == b[j];\tz = z" },
+	{ "OP_EQ_AA",		"if b[j] == c[k];\tz = z" },
+	{ "OP_NEQ_VV",		"if x != w;\tz = z" },
+	{ "OP_NEQ_VA",		"if v != b[j];\tz = z" },
+	{ "OP_NEQ_AA",		"if b[j] != c[j];\tz = z" },
+	{ "OP_LE_VV",		"if z <= y;\tz = z" },
+	{ "OP_LE_VA",		"if y <= b[j];\tz = z" },
+	{ "OP_LE_AV",		"if c[k] <= x;\tz = z" },
+	{ "OP_LE_AA",		"if c[k] <= b[j];\tz = z" },
+	{ "OP_LT_VV",		"if y < x;\tz = z" },
+	{ "OP_LT_VA",		"if x < b[j];\tz = z" },
+	{ "OP_LT_AV",		"if c[k] < x;\tz = z" },
+	{ "OP_LT_AA",		"if c[k] < b[j];\tz = z" },
+};
+
+#define STATEMENT_N (int)(sizeof(statements) / sizeof(*statements))
+#define SETUP_N (int)(sizeof(setup) / sizeof(*setup))
+
+typedef struct {
+	double seconds;
+	uint64_t cycles, branch_misses;
+	bool has_cycles, has_branch_misses;
+} Measurement;
+
+// Synthetic bytecode of the benchmark
+typedef struct {
+	Bytecode bytecode;
+	int start;				// of the first copy
+	int body_size;			// words of one copy of the statements
+	int counter;			// variable of the loop's iterations
+} Bench;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static String find_statement(String arg) {
+	for(int i = 0; i < STATEMENT_N; i++)
+		if(strcmp(statements[i].opcode, arg) == 0)
+			return statements[i].statement;
+	return arg;
+}
+
+// appends statement to source, one line per ';'. The indentation can also be written as
+// "\t" (for the command line)
+static void add_statement(Vector source, String statement) {
+	char* copy = strdup(statement);
+	for(char* line = strtok(copy, ";"); line != NULL; line = strtok(NULL, ";")) {
+		char buf[strlen(line) + 2];
+		int n = 0;
+		for(char* c = line; *c != '\0'; c++) {
+			if(c[0] == '\\' && c[1] == 't') {
+				buf[n++] = '\t';
+				c++;
+			} else {
+				buf[n++] = *c;
+			}
+		}
+		buf[n++] = '\n';
+		buf[n] = '\0';
+		vector_insert_last(source, strdup(buf));
+	}
+	free(copy);
+}
+
+// Compiles the setup followed by the statements, and replaces its code after the setup with
+// the loop. Returns false (with the error printed) if the statements do not compile.
+static bool bench_create(Bench* bench, String statements[], int statement_n, int copies, int iterations) {
+	Vector source = vector_create(0, free);
+	for(int i = 0; i < SETUP_N; i++)
+		add_statement(source, setup[i]);
+	for(int i = 0; i < statement_n; i++)
+		add_statement(source, statements[i]);
+
+	char error[PARSER_ERROR_SIZE];
+	Bytecode bytecode = parser_compile(source, false, error);
+	vector_destroy(source);
+	if(bytecode == NULL) {
+		fprintf(stderr, "%s\n", error);
+		return false;
+	}
+
+	// the statements are the words after the setup's lines, up to the final OP_HALT
+	int start = 0;
+	while(start < bytecode->word_n && bytecode->lines[start] <= SETUP_N)
+		start++;
+	int end = bytecode->word_n - 1;
+	while(end > start && WORD_TAG(bytecode->words[end]) != TAG_OPCODE)
+		end--;
+
+	bench->start = start;
+	bench->body_size = end - start;
+
+	// two more variables for the loop
+	int counter = bytecode->var_n, zero = bytecode->var_n + 1;
+	bench->counter = counter;
+	bytecode->var_n += 2;
+	bytecode->values = realloc(bytecode->values, bytecode->var_n * sizeof(*bytecode->values));
+	bytecode->values[counter] = iterations;
+	bytecode->values[zero] = 0;
+	bytecode->var_names = realloc(bytecode->var_names, bytecode->var_n * sizeof(*bytecode->var_names));
+	bytecode->var_names[counter] = "iterations";
+	bytecode->var_names[zero] = "zero";
+
+	int word_n = start + copies * bench->body_size + 7;
+	Word* words = malloc(word_n * sizeof(*words));
+	int* lines = calloc(word_n, sizeof(*lines));
+	memcpy(words, bytecode->words, start * sizeof(*words));
+	memcpy(lines, bytecode->lines, start * sizeof(*lines));
+
+	int pos = start;
+	for(int c = 0; c < copies; c++, pos += bench->body_size) {
+		memcpy(words + pos, bytecode->words + start, bench->body_size * sizeof(*words));		// jumps are relative
+		memcpy(lines + pos, bytecode->lines + start, bench->body_size * sizeof(*lines));
+	}
+	words[pos++] = WORD(TAG_OPCODE, OP_DEC_V);
+	words[pos++] = WORD(TAG_VAR, counter);
+	words[pos++] = WORD(TAG_OPCODE, OP_LE_VV);		// jumps back if not iterations <= 0
+	words[pos] = WORD(TAG_JUMP, start - pos);
+	pos++;
+	words[pos++] = WORD(TAG_VAR, counter);
+	words[pos++] = WORD(TAG_VAR, zero);
+	words[pos++] = WORD(TAG_OPCODE, OP_HALT);
+
+	free(bytecode->words);
+	free(bytecode->lines);
+	bytecode->words = words;
+	bytecode->lines = lines;
+	bytecode->word_n = word_n;
+	bytecode->loop_n = 0;		// the loop is not a while of the source
+	bench->bytecode = bytecode;
+	return true;
+}
+
+// runs the bench's bytecode, the fastest of runs
+static Measurement bench_run(Bench* bench, int runs) {
+	Measurement best = { .seconds = -1 };
+	Runtime runtime = interpreter_create_runtime(bench->bytecode, interpreter_stdio(), 0);
+	for(int r = 0; r < runs; r++) {
+		runtime->counters = counters_create(bench->bytecode);
+		interpreter_reset(runtime, 0, NULL);
+
+		double start = now();
+		RunStatus status = interpreter_run(runtime);
+		double seconds = now() - start;
+		if(status != RUN_OK)
+			fprintf(stderr, "run stopped with status %d\n", status);
+
+		if(best.seconds < 0 || seconds < best.seconds) {
+			best.seconds = seconds;
+			best.has_cycles = counters_total(runtime->counters, "cycles", &best.cycles);
+			best.has_branch_misses = counters_total(runtime->counters, "branch-misses", &best.branch_misses);
+		}
+		counters_destroy(runtime->counters);
+		runtime->counters = NULL;
+	}
+	interpreter_destroy_runtime(runtime);
+	return best;
+}
+
+// the instructions dispatched by one copy of the statements (not those of the if bodies
+// that are skipped), from a profiled run of a single iteration
+static int bench_dispatches(Bench* bench, int copies) {
+	Runtime runtime = interpreter_create_runtime(bench->bytecode, interpreter_stdio(), 0);
+	runtime->profile = true;
+	interpreter_reset(runtime, 0, NULL);
+	runtime->frame[bench->counter] = 1;
+	interpreter_run(runtime);
+
+	uint64_t dispatches = 0;
+	for(int pos = bench->start; pos < bench->start + copies * bench->body_size; pos++)
+		dispatches += runtime->exec_count[pos];
+	interpreter_destroy_runtime(runtime);
+	return dispatches / copies;
+}
+
+// prints the cost of one copy of the statements, and per dispatched instruction
+static bool bench_statements(String args[], int arg_n, int copies, int iterations, int runs, bool verbose) {
+	String statements[arg_n];
+	for(int i = 0; i < arg_n; i++)
+		statements[i] = find_statement(args[i]);
+
+	Bench bench, baseline = { 0 };
+	if(!bench_create(&bench, statements, arg_n, copies, iterations))
+		return false;
+	bench_create(&baseline, statements, arg_n, 0, iterations);
+
+	// the opcodes given should be in the compiled statements
+	for(int i = 0; i < arg_n; i++) {
+		if(statements[i] == args[i])
+			continue;
+		bool found = false;
+		for(int pos = bench.start; pos < bench.start + bench.body_size && !found; pos++)
+			found = WORD_TAG(bench.bytecode->words[pos]) == TAG_OPCODE && strcmp(interpreter_opcode_name(WORD_VALUE(bench.bytecode->words[pos])), args[i]) == 0;
+		if(!found)
+			fprintf(stderr, "warning: \"%s\" does not compile to %s\n", statements[i], args[i]);
+	}
+
+	if(verbose) {
+		for(int pos = bench.start; pos < bench.start + bench.body_size; pos++)
+			if(WORD_TAG(bench.bytecode->words[pos]) == TAG_OPCODE) {
+				printf("    ");
+				print_instruction(bench.bytecode, pos, stdout);
+				printf("\n");
+			}
+	}
+
+	int dispatches = bench_dispatches(&bench, copies);
+	Measurement m = bench_run(&bench, runs);
+	Measurement base = bench_run(&baseline, runs);
+	double copy_n = (double)copies * iterations;
+	double dispatch_n = copy_n * dispatches;
+
+	char name[64] = "";
+	for(int i = 0; i < arg_n; i++)
+		snprintf(name + strlen(name), sizeof(name) - strlen(name), "%s%s", i > 0 ? " + " : "", args[i]);
+	printf("%-28s %6d %10.3f %10.3f", name, dispatches,
+		(m.seconds - base.seconds) / copy_n * 1e9, (m.seconds - base.seconds) / dispatch_n * 1e9);
+	if(m.has_cycles)
+		printf(" %10.2f", ((double)m.cycles - base.cycles) / dispatch_n);
+	else
+		printf(" %10s", "-");
+	if(m.has_branch_misses)
+		printf(" %10.4f", ((double)m.branch_misses - base.branch_misses) / dispatch_n);
+	else
+		printf(" %10s", "-");
+	printf("\n");
+	fflush(stdout);
+
+	parser_destroy_bytecode(bench.bytecode);
+	parser_destroy_bytecode(baseline.bytecode);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	int first_arg = 1;
+	int iterations = DEFAULT_ITERATIONS;
+	int copies = DEFAULT_COPIES;
+	int runs = DEFAULT_RUNS;
+	bool all = false;
+	bool verbose = false;
+	for(; first_arg < argc && argv[first_arg][0] == '-'; first_arg++) {
+		if(strcmp(argv[first_arg], "-n") == 0 && first_arg + 1 < argc)
+			iterations = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "-k") == 0 && first_arg + 1 < argc)
+			copies = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "-r") == 0 && first_arg + 1 < argc)
+			runs = atoi(argv[++first_arg]);
+		else if(strcmp(argv[first_arg], "--all") == 0)
+			all = true;
+		else if(strcmp(argv[first_arg], "-v") == 0)
+			verbose = true;
+		else
+			break;
+	}
+
+	int arg_n = argc - first_arg;
+	if((!all && arg_n != 1 && arg_n != 2) || (all && arg_n != 0) || iterations < 1 || copies < 1 || runs < 1) {
+		fprintf(stderr, "usage: ipli-opbench [-n ITERATIONS] [-k COPIES] [-r RUNS] [-v] (--all | STATEMENT [STATEMENT])\n");
+		fprintf(stderr, "  STATEMENT  an IPL statement (lines separated by ';', \\t indents) or an opcode, eg OP_ADD_AAA,\n");
+		fprintf(stderr, "           which stands for a statement compiled to it. With two statements,\n");
+		fprintf(stderr, "           they alternate. The setup defines the variables i, j, k, v, w, x, y, z\n");
+		fprintf(stderr, "           and the arrays a, b, c\n");
+		fprintf(stderr, "  --all    measure all opcodes that have a statement\n");
+		fprintf(stderr, "  -n       iterations of the loop (default %d)\n", DEFAULT_ITERATIONS);
+		fprintf(stderr, "  -k       copies of the statements in the loop (default %d)\n", DEFAULT_COPIES);
+		fprintf(stderr, "  -r       runs, the fastest is reported (default %d)\n", DEFAULT_RUNS);
+		fprintf(stderr, "  -v       print the instructions of each statement\n");
+		return -1;
+	}
+
+	printf("%-28s %6s %10s %10s %10s %10s\n", "statement", "disp", "ns/copy", "ns/disp", "cyc/disp", "brmiss/disp");
+	if(all) {
+		for(int i = 0; i < STATEMENT_N; i++)
+			bench_statements(&statements[i].opcode, 1, copies, iterations, runs, verbose);
+		return 0;
+	}
+	return bench_statements(argv + first_arg, arg_n, copies, iterations, runs, verbose) ? 0 : 1;
+}
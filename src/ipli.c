@@ -0,0 +1,67 @@
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "ipli.h"
+#include "parser.h"
+#include "interpreter.h"
+
+
+IpliStatus ipli_compile(const char* source, size_t length, IpliProgram* program, char* error, size_t error_size) {
+	// the parser works on a vector of lines, which it modifies
+	char* text = malloc(length + 1);
+	memcpy(text, source, length);
+	text[length] = '\0';
+
+	Vector lines = vector_create(0, NULL);
+	for(char* line = text; *line != '\0'; ) {
+		vector_insert_last(lines, line);
+		char* newline = strchr(line, '\n');
+		if(newline == NULL)
+			break;
+		*newline = '\0';
+		line = newline + 1;
+	}
+
+	char message[PARSER_ERROR_SIZE];
+	*program = parser_compile(lines, false, message);
+	if(*program == NULL && error != NULL)
+		snprintf(error, error_size, "%s", message);
+
+	vector_destroy(lines);
+	free(text);
+	return *program != NULL ? IPLI_OK : IPLI_ERROR_SYNTAX;
+}
+
+void ipli_program_destroy(IpliProgram program) {
+	parser_destroy_bytecode(program);
+}
+
+IpliRuntime ipli_runtime_create(IpliProgram program, const IpliIO* io, uint64_t seed) {
+	IO runtime_io = io != NULL
+		? (IO){ .write = io->write, .read = io->read, .data = io->data }
+		: interpreter_stdio();
+	return interpreter_create_runtime(program, runtime_io, seed);
+}
+
+IpliStatus ipli_run(IpliRuntime runtime, int arg_n, const char* args[]) {
+	interpreter_reset(runtime, arg_n, (String*)args);
+	RunStatus status = interpreter_run(runtime);
+	switch(status) {
+		case RUN_OK:				return IPLI_OK;
+		case RUN_NO_INPUT:			return IPLI_ERROR_INPUT;
+		case RUN_SIZE_MISMATCH:		return IPLI_ERROR_SIZE;
+		case RUN_DIVISION_ERROR:	return IPLI_ERROR_DIVISION;
+		case RUN_OUT_OF_MEMORY:		// the library sets no memory limit
+		case RUN_INTERRUPTED:		// and never interrupts a run
+		default:
+			assert(false);
+			return IPLI_ERROR_INPUT;
+	}
+}
+
+void ipli_runtime_destroy(IpliRuntime runtime) {
+	interpreter_destroy_runtime(runtime);
+}
@@ -0,0 +1,224 @@
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <stdbool.h>
+
+#include "kernels.h"
+
+// The AVX2 versions process 8 ints per step (unaligned, arrays are only int aligned),
+// the remaining elements are handled by the scalar loop.
+
+// element k of a strided read
+#define AT(a, x, s, k) (a)[(int)((unsigned int)(x) + (unsigned int)(s) * (unsigned int)(k))]
+
+#ifdef __AVX2__
+// elements k .. k+7 of a strided read, gathered unless contiguous
+static inline __m256i load8(const int* a, int x, int s, long k) {
+	if(s == 1)
+		return _mm256_loadu_si256((const __m256i*)(a + x + k));
+	__m256i lanes = _mm256_mullo_epi32(_mm256_set1_epi32(s), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i first = _mm256_set1_epi32((unsigned int)x + (unsigned int)s * (unsigned int)k);
+	return _mm256_i32gather_epi32(a, _mm256_add_epi32(first, lanes), 4);
+}
+
+// combines the 8 lanes of v with op (eg _mm_add_epi32)
+#define HORIZONTAL(v, op) ({															\
+	__m128i h = op(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));		\
+	h = op(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));						\
+	h = op(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));						\
+	_mm_cvtsi128_si32(h);															\
+})
+#endif
+
+void kernel_fill(int* a, long n, int value) {
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i v = _mm256_set1_epi32(value);
+	for(; k + 8 <= n; k += 8)
+		_mm256_storeu_si256((__m256i*)(a + k), v);
+	#endif
+	for(; k < n; k++)
+		a[k] = value;
+}
+
+void kernel_copy(int* dst, const int* src, long n) {
+	if(dst == src)
+		return;
+	long k = 0;
+	#ifdef __AVX2__
+	for(; k + 8 <= n; k += 8)
+		_mm256_storeu_si256((__m256i*)(dst + k), _mm256_loadu_si256((const __m256i*)(src + k)));
+	#endif
+	for(; k < n; k++)
+		dst[k] = src[k];
+}
+
+void kernel_iota(int* a, long n, int first) {
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i v = _mm256_add_epi32(_mm256_set1_epi32(first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i step = _mm256_set1_epi32(8);
+	for(; k + 8 <= n; k += 8) {
+		_mm256_storeu_si256((__m256i*)(a + k), v);
+		v = _mm256_add_epi32(v, step);
+	}
+	#endif
+	for(; k < n; k++)
+		a[k] = first + k;
+}
+
+int kernel_sum(const int* a, int x, int s, long n) {
+	unsigned int sum = 0;
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i acc = _mm256_setzero_si256();
+	for(; k + 8 <= n; k += 8)
+		acc = _mm256_add_epi32(acc, load8(a, x, s, k));
+	sum = HORIZONTAL(acc, _mm_add_epi32);
+	#endif
+	for(; k < n; k++)
+		sum += AT(a, x, s, k);
+	return sum;
+}
+
+int kernel_dot(const int* a, int x, int sx, const int* b, int y, int sy, long n) {
+	unsigned int sum = 0;
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i acc = _mm256_setzero_si256();
+	for(; k + 8 <= n; k += 8)
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(load8(a, x, sx, k), load8(b, y, sy, k)));
+	sum = HORIZONTAL(acc, _mm_add_epi32);
+	#endif
+	for(; k < n; k++)
+		sum += (unsigned int)AT(a, x, sx, k) * (unsigned int)AT(b, y, sy, k);
+	return sum;
+}
+
+int kernel_min(const int* a, int x, int s, long n, int init) {
+	int min = init;
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i acc = _mm256_set1_epi32(init);
+	for(; k + 8 <= n; k += 8)
+		acc = _mm256_min_epi32(acc, load8(a, x, s, k));
+	min = HORIZONTAL(acc, _mm_min_epi32);
+	#endif
+	for(; k < n; k++)
+		if(AT(a, x, s, k) < min)
+			min = AT(a, x, s, k);
+	return min;
+}
+
+int kernel_max(const int* a, int x, int s, long n, int init) {
+	int max = init;
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i acc = _mm256_set1_epi32(init);
+	for(; k + 8 <= n; k += 8)
+		acc = _mm256_max_epi32(acc, load8(a, x, s, k));
+	max = HORIZONTAL(acc, _mm_max_epi32);
+	#endif
+	for(; k < n; k++)
+		if(AT(a, x, s, k) > max)
+			max = AT(a, x, s, k);
+	return max;
+}
+
+static inline bool holds(int x, int value, Comparison compare) {
+	switch(compare) {
+		case CMP_EQ:	return x == value;
+		case CMP_NEQ:	return x != value;
+		case CMP_LT:	return x < value;
+		case CMP_LE:	return x <= value;
+		case CMP_GT:	return x > value;
+		default:		return x >= value;
+	}
+}
+
+#ifdef __AVX2__
+// bit j of the result is set if a[j] <compare> value, for 0 <= j < 8
+static inline int compare8(const int* a, __m256i value, Comparison compare) {
+	__m256i x = _mm256_loadu_si256((const __m256i*)a);
+	__m256i m =
+		compare == CMP_EQ || compare == CMP_NEQ ? _mm256_cmpeq_epi32(x, value) :
+		compare == CMP_LT || compare == CMP_GE ? _mm256_cmpgt_epi32(value, x) :
+		_mm256_cmpgt_epi32(x, value);
+	int mask = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+	return compare == CMP_NEQ || compare == CMP_GE || compare == CMP_LE ? mask ^ 0xFF : mask;
+}
+#endif
+
+long kernel_search(const int* a, long n, int value, Comparison compare) {
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i v = _mm256_set1_epi32(value);
+	for(; k + 8 <= n; k += 8) {
+		int mask = compare8(a + k, v, compare);
+		if(mask != 0)
+			return k + __builtin_ctz(mask);
+	}
+	#endif
+	for(; k < n; k++)
+		if(holds(a[k], value, compare))
+			return k;
+	return n;
+}
+
+long kernel_count(const int* a, long n, int value, Comparison compare) {
+	long count = 0;
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i v = _mm256_set1_epi32(value);
+	for(; k + 8 <= n; k += 8)
+		count += __builtin_popcount(compare8(a + k, v, compare));
+	#endif
+	for(; k < n; k++)
+		count += holds(a[k], value, compare);
+	return count;
+}
+
+#ifdef __AVX2__
+static inline __m256i elementwise8(__m256i x, __m256i y, ElementOp op) {
+	__m256i one = _mm256_set1_epi32(1);
+	switch(op) {
+		case ELEM_ADD:	return _mm256_add_epi32(x, y);
+		case ELEM_SUB:	return _mm256_sub_epi32(x, y);
+		case ELEM_MUL:	return _mm256_mullo_epi32(x, y);
+		case ELEM_EQ:	return _mm256_and_si256(_mm256_cmpeq_epi32(x, y), one);		// the masks are -1 or 0
+		case ELEM_NEQ:	return _mm256_add_epi32(_mm256_cmpeq_epi32(x, y), one);
+		case ELEM_LT:	return _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one);
+		case ELEM_LE:	return _mm256_add_epi32(_mm256_cmpgt_epi32(x, y), one);
+		case ELEM_GT:	return _mm256_and_si256(_mm256_cmpgt_epi32(x, y), one);
+		default:		return _mm256_add_epi32(_mm256_cmpgt_epi32(y, x), one);
+	}
+}
+#endif
+
+static inline int elementwise(int x, int y, ElementOp op) {
+	switch(op) {
+		case ELEM_ADD:	return (unsigned int)x + (unsigned int)y;
+		case ELEM_SUB:	return (unsigned int)x - (unsigned int)y;
+		case ELEM_MUL:	return (unsigned int)x * (unsigned int)y;
+		default:		return holds(x, y, (Comparison)(op - ELEM_EQ));
+	}
+}
+
+void kernel_elementwise(int* dst, const int* x, int x_step, const int* y, int y_step, long n, ElementOp op) {
+	if(n == 0)
+		return;		// x[0], y[0] might not exist
+	long k = 0;
+	#ifdef __AVX2__
+	__m256i vx = _mm256_set1_epi32(x[0]), vy = _mm256_set1_epi32(y[0]);
+	for(; k + 8 <= n; k += 8) {
+		if(x_step != 0)
+			vx = _mm256_loadu_si256((const __m256i*)(x + k));
+		if(y_step != 0)
+			vy = _mm256_loadu_si256((const __m256i*)(y + k));
+		_mm256_storeu_si256((__m256i*)(dst + k), elementwise8(vx, vy, op));
+	}
+	#endif
+	for(; k < n; k++)
+		dst[k] = elementwise(x[k * x_step], y[k * y_step], op);
+}
@@ -0,0 +1,60 @@
+
+#pragma once
+
+// Bulk operations on the program's arrays, executed by the instructions of loop
+// idioms (see idiom.h). They use AVX2 when compiled for it (eg -march=native), and
+// plain loops otherwise. Arithmetic wraps around at 32 bits, like the interpreter's.
+
+// a[k] = value, for 0 <= k < n
+void kernel_fill(int* a, long n, int value);
+
+// dst[k] = src[k], for 0 <= k < n. The arrays do not overlap, or are the same.
+void kernel_copy(int* dst, const int* src, long n);
+
+// a[k] = first + k, for 0 <= k < n
+void kernel_iota(int* a, long n, int first);
+
+// Reductions of a[x + k*s], for 0 <= k < n (the index also wraps around)
+
+int kernel_sum(const int* a, int x, int s, long n);
+
+// sum of a[x + k*sx] * b[y + k*sy]
+int kernel_dot(const int* a, int x, int sx, const int* b, int y, int sy, long n);
+
+// min/max of init and the elements
+int kernel_min(const int* a, int x, int s, long n, int init);
+int kernel_max(const int* a, int x, int s, long n, int init);
+
+// Comparisons of an element with a value
+
+typedef enum {
+	CMP_EQ,
+	CMP_NEQ,
+	CMP_LT,
+	CMP_LE,
+	CMP_GT,
+	CMP_GE,
+} Comparison;
+
+// the first k < n with a[k] <compare> value, or n if there is none
+long kernel_search(const int* a, long n, int value, Comparison compare);
+
+// the number of k < n with a[k] <compare> value
+long kernel_count(const int* a, long n, int value, Comparison compare);
+
+// Elementwise operations, dst[k] = x[k] <op> y[k] for 0 <= k < n, where an operand with
+// step 0 is a scalar (x[0] for all k). Comparisons give 1 or 0. dst can be x or y.
+
+typedef enum {
+	ELEM_ADD,
+	ELEM_SUB,
+	ELEM_MUL,
+	ELEM_EQ,		// the comparisons, in the order of Comparison
+	ELEM_NEQ,
+	ELEM_LT,
+	ELEM_LE,
+	ELEM_GT,
+	ELEM_GE,
+} ElementOp;
+
+void kernel_elementwise(int* dst, const int* x, int x_step, const int* y, int y_step, long n, ElementOp op);
@@ -0,0 +1,535 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "parallel.h"
+
+// Abstract value of a scalar in an iteration of the analyzed loop, i is its counter
+typedef enum {
+	TOP,		// anything
+	CONST,		// the literal s (literals are non-negative)
+	NONNEG,		// >= 0
+	RANGE,		// 0 <= v < s
+	SCALED,		// v == i * s
+	OWNED,		// i * s <= v < i * s + s, values that only iteration i produces
+} Kind;
+
+typedef struct {
+	Kind kind;
+	String s;
+} Value;
+
+// What the loop body does with each scalar
+typedef struct {
+	int pos;				// in the Value/definitely assigned arrays
+	int reads, writes;
+	int reduction_writes;	// writes of the form var = var + x (see reduction_op)
+	char reduction_op;		// '+' or '*', -1 if both are used
+	bool reduction;
+}* VarInfo;
+
+typedef struct {
+	Statement loop;
+	Statement increment;	// counter = counter + 1, the last statement of the body
+	String counter;
+	Arena arena;
+	Map vars;				// scalar name => VarInfo
+	Map arrays;				// modified array name => S of the indexes owned by an iteration ("" until known)
+	int var_n;
+	bool ok;
+} Analysis;
+
+
+static bool is_literal(String token) {
+	return *token >= '0' && *token <= '9';
+}
+
+// for "a[x]" returns a copy of "a", and the index "x" in *index. NULL for scalars
+static String split_array(String token, String* index, Arena arena) {
+	String bracket = strchr(token, '[');
+	if(bracket == NULL)
+		return NULL;
+
+	String name = arena_strdup(arena, token);
+	name[bracket - token] = '\0';
+	*index = name + (bracket - token) + 1;
+	(*index)[strlen(*index) - 1] = '\0';
+	return name;
+}
+
+// The tokens a statement reads (scalars or array elements), returns their number. *target
+// is the token it assigns (NULL if none), the index of an array target is also read.
+static int statement_operands(Statement stm, String operands[], String* target) {
+	String* t = stm->tokens;
+	*target = NULL;
+	switch(stm->type) {
+		case WRITE:
+		case WRITELN:		operands[0] = t[1];							return 1;
+		case READ:
+		case RAND:
+		case NEW:			*target = t[1];								return 0;
+		case ASSIGN_VAR:	*target = t[0]; operands[0] = t[2];			return 1;
+		case ASSIGN_EXP:	*target = t[0]; operands[0] = t[2]; operands[1] = t[4];	return 2;
+		case IF:
+		case WHILE:			operands[0] = t[1]; operands[1] = t[3];		return 2;
+		case ARG:			*target = t[2]; operands[0] = t[1];			return 1;
+		case ARG_SIZE:
+		case SIZE:			*target = t[2];								return 0;
+		default:														return 0;
+	}
+}
+
+// for var = var + x, var = x + var, var = var - x returns '+', for var = var * x, var = x * var '*'
+static char reduction_op(Statement stm) {
+	if(stm->type != ASSIGN_EXP)
+		return 0;
+	String var = stm->tokens[0], op = stm->tokens[3];
+	bool left = strcmp(stm->tokens[2], var) == 0;
+	bool right = strcmp(stm->tokens[4], var) == 0;
+	if(left == right)
+		return 0;
+	return op[0] == '+' || (op[0] == '-' && left) ? '+' : op[0] == '*' ? '*' : 0;
+}
+
+static VarInfo var_info(Analysis* a, String name) {
+	return map_find(a->vars, name);
+}
+
+
+// Pass 1: what the body reads and writes /////////////////////////////////////////////
+
+static void count_read(Analysis* a, String name) {
+	if(is_literal(name))
+		return;
+	VarInfo info = var_info(a, name);
+	if(info == NULL) {
+		info = arena_alloc(a->arena, sizeof(*info));
+		info->pos = a->var_n++;
+		map_insert(a->vars, name, info);
+	}
+	info->reads++;
+}
+
+static void count_operand(Analysis* a, String token) {
+	String index;
+	String array = split_array(token, &index, a->arena);
+	count_read(a, array != NULL ? index : token);
+}
+
+// depth: number of loops in the body that contain stm
+static void collect(Analysis* a, Program prog, int depth) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		String operands[2], target;
+		int operand_n = statement_operands(stm, operands, &target);
+		for(int i = 0; i < operand_n; i++)
+			count_operand(a, operands[i]);
+
+		if(target != NULL) {
+			String index;
+			String array = split_array(target, &index, a->arena);
+			if(array != NULL) {
+				count_read(a, index);
+				if(map_find(a->arrays, array) == NULL)
+					map_insert(a->arrays, array, "");
+			} else {
+				count_read(a, target);		// creates the info
+				VarInfo info = var_info(a, target);
+				info->reads--;
+				info->writes++;
+				char op = reduction_op(stm);
+				if(op != 0) {
+					info->reduction_writes++;
+					info->reduction_op = info->reduction_op == 0 || info->reduction_op == op ? op : -1;
+				}
+			}
+		}
+
+		switch(stm->type) {
+			case READ:
+			case RAND:
+			case NEW:
+			case FREE:
+			case READ_ARRAY:
+			case WRITE_ARRAY:
+			case WRITELN_ARRAY:
+			case ARRAY_ASSIGN:
+				a->ok = false;		// input/random order, reallocations, and whole arrays
+				break;
+			case BREAK:
+			case CONTINUE:
+				if((stm->tokens[1] ? atoi(stm->tokens[1]) : 1) > depth)
+					a->ok = false;	// leaves (or continues) the analyzed loop
+				break;
+			default:
+				break;
+		}
+
+		if(stm->body)
+			collect(a, stm->body, depth + (stm->type == WHILE ? 1 : 0));
+		if(stm->else_body)
+			collect(a, stm->else_body, depth);
+	}
+}
+
+
+// Pass 2: abstract execution of an iteration /////////////////////////////////////////
+
+static Value* copy_values(Analysis* a, Value* values) {
+	Value* copy = arena_alloc(a->arena, a->var_n * sizeof(*copy));
+	memcpy(copy, values, a->var_n * sizeof(*copy));
+	return copy;
+}
+
+static bool* copy_assigned(Analysis* a, bool* assigned) {
+	bool* copy = arena_alloc(a->arena, a->var_n * sizeof(*copy));
+	memcpy(copy, assigned, a->var_n * sizeof(*copy));
+	return copy;
+}
+
+static bool is_nonneg(Value v) {
+	return v.kind == CONST || v.kind == NONNEG || v.kind == RANGE;
+}
+
+static bool equal(Value x, Value y) {
+	return x.kind == y.kind && (x.s == y.s || (x.s != NULL && y.s != NULL && strcmp(x.s, y.s) == 0));
+}
+
+static Value join(Value x, Value y) {
+	return
+		equal(x, y) ? x :
+		is_nonneg(x) && is_nonneg(y) ? (Value){ NONNEG, NULL } :
+		(Value){ TOP, NULL };
+}
+
+// a literal or a scalar not modified in the body
+static bool is_invariant(Analysis* a, String token) {
+	if(strchr(token, '[') != NULL)
+		return false;
+	VarInfo info = var_info(a, token);
+	return is_literal(token) || info == NULL || info->writes == 0;
+}
+
+static Value value_of(Analysis* a, String token, Value* values) {
+	if(is_literal(token))
+		return (Value){ CONST, token };
+	if(strcmp(token, a->counter) == 0)
+		return (Value){ SCALED, "1" };
+	VarInfo info = var_info(a, token);
+	return strchr(token, '[') == NULL && info != NULL && info->writes > 0 ? values[info->pos] : (Value){ TOP, NULL };
+}
+
+// value of x op y
+static Value transfer(Analysis* a, String x, String op, String y, Value* values) {
+	Value vx = value_of(a, x, values);
+	Value vy = value_of(a, y, values);
+	switch(op[0]) {
+		case '*':
+			if(strcmp(x, a->counter) == 0 && is_invariant(a, y))
+				return (Value){ SCALED, y };
+			if(strcmp(y, a->counter) == 0 && is_invariant(a, x))
+				return (Value){ SCALED, x };
+			break;
+		case '+':
+			if(vx.kind == RANGE && vy.kind == SCALED && equal((Value){ SCALED, vx.s }, vy))
+				return (Value){ OWNED, vx.s };
+			if(vy.kind == RANGE && vx.kind == SCALED && equal((Value){ SCALED, vy.s }, vx))
+				return (Value){ OWNED, vy.s };
+			break;
+		case '-':
+			return (Value){ TOP, NULL };
+	}
+	return is_nonneg(vx) && is_nonneg(vy) ? (Value){ NONNEG, NULL } : (Value){ TOP, NULL };
+}
+
+// S such that index is in [i*S, i*S + S), or NULL
+static String owned_size(Analysis* a, String index, Value* values) {
+	Value v = value_of(a, index, values);
+	return
+		v.kind == OWNED ? v.s :
+		v.kind == SCALED && is_literal(v.s) && atoi(v.s) >= 1 ? v.s :
+		NULL;
+}
+
+static void check_scalar_read(Analysis* a, String name, bool* assigned) {
+	VarInfo info = var_info(a, name);
+	if(is_literal(name) || strcmp(name, a->counter) == 0 || info == NULL || info->writes == 0)
+		return;
+	if(info->reduction || !assigned[info->pos])
+		a->ok = false;		// reads the value of a previous iteration
+}
+
+// a read, or the write of an array element
+static void check_access(Analysis* a, String token, Value* values, bool* assigned) {
+	String index;
+	String array = split_array(token, &index, a->arena);
+	if(array == NULL) {
+		check_scalar_read(a, token, assigned);
+		return;
+	}
+
+	check_scalar_read(a, index, assigned);
+	String size = map_find(a->arrays, array);
+	if(size == NULL)
+		return;		// not modified in the loop
+
+	String owned = owned_size(a, index, values);
+	if(owned == NULL || (*size != '\0' && strcmp(size, owned) != 0))
+		a->ok = false;
+	else
+		map_insert(a->arrays, array, owned);
+}
+
+static bool has_jumps(Program prog) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next)
+		if(stm->type == BREAK || stm->type == CONTINUE || has_jumps(stm->body) || has_jumps(stm->else_body))
+			return true;
+	return false;
+}
+
+// sets to TOP all scalars assigned in prog
+static void forget_assigned(Analysis* a, Program prog, Value* values) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		String operands[2], target;
+		statement_operands(stm, operands, &target);
+		VarInfo info = target != NULL && strchr(target, '[') == NULL ? var_info(a, target) : NULL;
+		if(info != NULL)
+			values[info->pos] = (Value){ TOP, NULL };
+		forget_assigned(a, stm->body, values);
+		forget_assigned(a, stm->else_body, values);
+	}
+}
+
+static void walk(Analysis* a, Program prog, Value* values, bool* assigned);
+
+// inner loop, values/assigned are updated to the state after the loop
+static void walk_while(Analysis* a, Statement stm, Value* values, bool* assigned) {
+	String* t = stm->tokens;
+	Value* entry = copy_values(a, values);
+	Value* head = copy_values(a, values);
+	if(has_jumps(stm->body))
+		forget_assigned(a, stm->body, head);	// the states at break/continue are not tracked
+
+	for(int iter = 0; ; iter++) {
+		// the condition is evaluated at the head, with the variables assigned before the loop
+		check_access(a, t[1], head, assigned);
+		check_access(a, t[3], head, assigned);
+
+		// in the body  j < S  holds, if j >= 0 at the head then 0 <= j < S
+		Value* body = copy_values(a, head);
+		String j = t[2][0] == '<' ? t[1] : t[3];
+		String s = t[2][0] == '<' ? t[3] : t[1];
+		VarInfo info = var_info(a, j);
+		if((strcmp(t[2], "<") == 0 || strcmp(t[2], ">") == 0) && info != NULL && info->writes > 0 &&
+		   is_invariant(a, s) && is_nonneg(body[info->pos]))
+			body[info->pos] = (Value){ RANGE, s };
+
+		walk(a, stm->body, body, copy_assigned(a, assigned));
+
+		// next head: join of the entry and the end of the body
+		Value* next = copy_values(a, body);
+		for(int i = 0; i < a->var_n; i++)
+			next[i] = join(entry[i], body[i]);
+		if(iter >= 4)
+			forget_assigned(a, stm->body, next);	// widening, stable after this
+
+		bool changed = false;
+		for(int i = 0; i < a->var_n; i++)
+			changed |= !equal(next[i], head[i]);
+		if(!changed)
+			break;
+		head = next;
+	}
+
+	memcpy(values, head, a->var_n * sizeof(*values));
+}
+
+static void walk(Analysis* a, Program prog, Value* values, bool* assigned) {
+	for(Statement stm = prog; stm != NULL && a->ok; stm = stm->next) {
+		if(stm == a->increment)
+			continue;
+		String* t = stm->tokens;
+
+		if(stm->type == WHILE) {
+			walk_while(a, stm, values, assigned);
+			continue;
+		}
+
+		if(stm->type == IF) {
+			check_access(a, t[1], values, assigned);
+			check_access(a, t[3], values, assigned);
+
+			Value* else_values = copy_values(a, values);
+			bool* else_assigned = copy_assigned(a, assigned);
+			walk(a, stm->body, values, assigned);
+			walk(a, stm->else_body, else_values, else_assigned);
+			for(int i = 0; i < a->var_n; i++) {
+				values[i] = join(values[i], else_values[i]);
+				assigned[i] = assigned[i] && else_assigned[i];
+			}
+			continue;
+		}
+
+		String operands[2], target;
+		int operand_n = statement_operands(stm, operands, &target);
+		VarInfo info = target != NULL && strchr(target, '[') == NULL ? var_info(a, target) : NULL;
+
+		// the reduction's own read is allowed, the other operand is checked
+		for(int i = 0; i < operand_n; i++)
+			if(!(info != NULL && info->reduction && strcmp(operands[i], target) == 0))
+				check_access(a, operands[i], values, assigned);
+
+		if(target == NULL)
+			continue;
+		if(info == NULL) {
+			check_access(a, target, values, assigned);		// array element
+		} else if(!info->reduction) {
+			values[info->pos] =
+				stm->type == ASSIGN_VAR ? value_of(a, t[2], values) :
+				stm->type == ASSIGN_EXP ? transfer(a, t[2], t[3], t[4], values) :
+				stm->type == SIZE || stm->type == ARG_SIZE ? (Value){ NONNEG, NULL } :
+				(Value){ TOP, NULL };
+			assigned[info->pos] = true;
+		}
+	}
+}
+
+
+// Whole program //////////////////////////////////////////////////////////////////////
+
+// true if the operands of stm (not its body) read name
+static bool statement_reads(Statement stm, String name, Arena arena) {
+	String operands[3], target;
+	int operand_n = statement_operands(stm, operands, &target);
+	if(target != NULL && strchr(target, '[') != NULL)
+		operands[operand_n++] = target;		// its index is read
+	for(int i = 0; i < operand_n; i++) {
+		String index;
+		String array = split_array(operands[i], &index, arena);
+		if(strcmp(array != NULL ? index : operands[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// true if name is read anywhere in prog, except in the skip statement
+static bool is_read(Program prog, String name, Statement skip, Arena arena) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next)
+		if(stm != skip && (statement_reads(stm, name, arena) || is_read(stm->body, name, skip, arena) || is_read(stm->else_body, name, skip, arena)))
+			return true;
+	return false;
+}
+
+// stores in path the statements that contain target (and target), from the outermost
+static bool find_path(Program prog, Statement target, Vector path) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		vector_insert_last(path, stm);
+		if(stm == target || find_path(stm->body, target, path) || find_path(stm->else_body, target, path))
+			return true;
+		vector_remove_last(path);
+	}
+	return false;
+}
+
+// true if name may be read after loop finishes: by the statements following it, or
+// by any enclosing loop (except in loop itself, where it is assigned before being read)
+static bool is_read_after(Program program, Statement loop, String name, Arena arena) {
+	Vector path = vector_create(0, NULL);
+	find_path(program, loop, path);
+
+	bool read = false;
+	for(int k = vector_size(path) - 1; k >= 0 && !read; k--) {
+		Statement stm = vector_get_at(path, k);
+		Statement parent = k > 0 ? vector_get_at(path, k - 1) : NULL;
+		read =
+			is_read(stm->next, name, loop, arena) ||
+			(parent != NULL && parent->type == WHILE && (statement_reads(parent, name, arena) || is_read(parent->body, name, loop, arena)));
+	}
+	vector_destroy(path);
+	return read;
+}
+
+static ParallelLoop analyze_loop(Statement loop, Program program, Arena arena) {
+	String* t = loop->tokens;
+	bool up = t[2][0] == '<';
+	if(!up && t[2][0] != '>')
+		return NULL;
+
+	Analysis a = {
+		.loop = loop,
+		.counter = up ? t[1] : t[3],
+		.arena = arena,
+		.vars = map_create((CompareFunc)strcmp, NULL, NULL),
+		.arrays = map_create((CompareFunc)strcmp, NULL, NULL),
+		.ok = true,
+	};
+	map_set_hash_function(a.vars, hash_string);
+	map_set_hash_function(a.arrays, hash_string);
+	String bound = up ? t[3] : t[1];
+
+	// the last statement must be  counter = counter + 1
+	for(a.increment = loop->body; a.increment != NULL && a.increment->next != NULL; a.increment = a.increment->next)
+		;
+	Statement inc = a.increment;
+	a.ok = inc != NULL && inc->type == ASSIGN_EXP && strcmp(inc->tokens[0], a.counter) == 0 && strcmp(inc->tokens[3], "+") == 0 &&
+		((strcmp(inc->tokens[2], a.counter) == 0 && strcmp(inc->tokens[4], "1") == 0) ||
+		 (strcmp(inc->tokens[4], a.counter) == 0 && strcmp(inc->tokens[2], "1") == 0));
+	a.ok = a.ok && !is_literal(a.counter) && strchr(a.counter, '[') == NULL && strchr(bound, '[') == NULL && strcmp(a.counter, bound) != 0;
+
+	if(a.ok)
+		collect(&a, loop->body, 0);
+
+	VarInfo counter = var_info(&a, a.counter);
+	a.ok = a.ok && counter != NULL && counter->writes == 1 && is_invariant(&a, bound);
+
+	// the scalars that are only updated as reductions
+	ParallelLoop result = NULL;
+	if(a.ok) {
+		result = arena_alloc(arena, sizeof(*result));
+		result->counter = a.counter;
+		result->bound = bound;
+		result->inclusive = t[2][1] == '=';
+
+		for(MapNode node = map_first(a.vars); node != MAP_EOF; node = map_next(a.vars, node)) {
+			VarInfo info = map_node_value(a.vars, node);
+			if(info != counter && info->writes > 0 && info->reduction_writes == info->writes &&
+			   info->reads == info->writes && info->reduction_op != -1) {
+				info->reduction = true;
+				Reduction reduction = arena_alloc(arena, sizeof(*reduction));
+				reduction->var = map_node_key(a.vars, node);
+				reduction->mul = info->reduction_op == '*';
+				reduction->next = result->reductions;
+				result->reductions = reduction;
+			}
+		}
+	}
+
+	if(a.ok) {
+		Value* values = arena_alloc(arena, a.var_n * sizeof(*values));		// all TOP
+		bool* assigned = arena_alloc(arena, a.var_n * sizeof(*assigned));
+		walk(&a, loop->body, values, assigned);
+
+		// the value of a private that is not assigned in all paths cannot be restored after the loop
+		for(MapNode node = map_first(a.vars); node != MAP_EOF && a.ok; node = map_next(a.vars, node)) {
+			VarInfo info = map_node_value(a.vars, node);
+			if(info != counter && info->writes > 0 && !info->reduction && !assigned[info->pos] &&
+			   is_read_after(program, loop, map_node_key(a.vars, node), arena))
+				a.ok = false;
+		}
+	}
+
+	map_destroy(a.vars);
+	map_destroy(a.arrays);
+	return a.ok ? result : NULL;
+}
+
+static void find_loops(Program prog, Program program, Arena arena) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		if(stm->type == WHILE && (stm->parallel = analyze_loop(stm, program, arena)) != NULL)
+			continue;		// inner loops are executed by the same thread
+		find_loops(stm->body, program, arena);
+		find_loops(stm->else_body, program, arena);
+	}
+}
+
+void parallel_analyze(Program program, Arena arena) {
+	find_loops(program, program, arena);
+}
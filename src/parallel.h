@@ -0,0 +1,27 @@
+
+#pragma once
+
+#include "parser.h"
+
+// Finds the while loops whose iterations can be executed in parallel, and sets their
+// Statement.parallel. Only the outermost such loops are marked. A loop qualifies if:
+//
+//  - Its condition is  counter < bound  (or <=, or the mirrored >, >=), the bound is
+//    not modified in the body and the last statement of the body is  counter = counter + 1
+//    (the only modification of the counter).
+//
+//  - Every other scalar modified in the body is either
+//      private: in every iteration it is assigned before being read. If it is not
+//               assigned in all paths it must not be read after the loop.
+//      reduction: only updated as  var = var + x, var = var - x  or only as  var = var * x,
+//                 and never read otherwise.
+//
+//  - Every array modified in the body is only accessed (read or written) at indexes owned
+//    by the current iteration: the counter, or counter * S + j with 0 <= j < S (S constant
+//    in the loop, j eg the counter of an inner  while j < S  loop starting from j >= 0).
+//
+//  - There are no read, random, new or free statements, and no break/continue for this
+//    loop or an outer one.
+//
+// Output statements are allowed, the interpreter keeps the output in order.
+void parallel_analyze(Program program, Arena arena);
@@ -2,22 +2,53 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "parser.h"
-#include "interpreter.h"
-
-
-
-// these should be called for all memory allocated for
-// the program's variables and arrays.
-int* parser_alloc(int int_n, Runtime runtime) {
-	int* p = calloc(int_n, sizeof(int));
-	set_insert(runtime->allocs, p);
-	return p;
+#include "parallel.h"
+#include "idiom.h"
+
+
+
+// Compilation state, the result is a Bytecode
+typedef struct compiler {
+	Arena arena;		// Statements, BCInstructions and symbols are allocated here
+	Vector code;		// Vector of BCInstruction
+	Map symbols;		// name => interned name
+	Map variables;		// interned name => variable slot (Word)
+	Map arrays;			// interned name => array slot (Word)
+	Map array_bits;		// interned name => element bits, of the arrays declared by new
+	Vector values;		// initial value of each variable slot
+	Vector names;		// name of each variable slot, then of each array slot (in the order of array_names)
+	Vector array_names;
+	Vector loops;		// LoopRange of each while, in instruction positions
+	Vector links;		// open bodies during parse (see parse)
+	Vector lasts;
+	Vector while_stack;	// enclosing whiles during set_break_continue_offsets
+	int array_n;
+	int line;			// of the statement being generated
+	double idiom_time;	// spent in idiom_match, idiom_prefetch
+	String error;
+	jmp_buf on_error;
+}* Compiler;
+
+// monotonic, in seconds
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-void parser_free(Pointer p, Runtime runtime) {
-	set_remove(runtime->allocs, p);	// this does the free
+// stops compilation, parser_compile returns NULL with the formatted message
+static void compile_error(Compiler compiler, const char* format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(compiler->error, PARSER_ERROR_SIZE, format, ap);
+	va_end(ap);
+	longjmp(compiler->on_error, 1);
 }
 
 // if token is of the form array[foo], it transforms it to array\0\foo\0 and returns foo
@@ -32,86 +63,142 @@ static String array_index(String token) {
 	return index;
 }
 
-static int* create_or_get_variable(String name, Runtime runtime) {
-	int* variable = map_find(runtime->variables, name);
-	if(variable == NULL) {
-		variable = parser_alloc(1, runtime);
-		*variable = *name >= '0' && *name <= '9' ? atoi(name) : 0;		// to create "constant variable"
-		map_insert(runtime->variables, name, variable);
+// returns the unique copy of name, so that the variables/arrays maps
+// can compare (and hash) symbols by pointer
+static String intern(String name, Compiler compiler) {
+	String symbol = map_find(compiler->symbols, name);
+	if(symbol == NULL) {
+		symbol = arena_strdup(compiler->arena, name);
+		map_insert(compiler->symbols, symbol, symbol);
+	}
+	return symbol;
+}
+
+static Word create_or_get_variable(String name, Compiler compiler) {
+	name = intern(name, compiler);
+	Word variable = (intptr_t)map_find(compiler->variables, name);
+	if(variable == 0) {
+		variable = WORD(TAG_VAR, vector_size(compiler->values));
+		int value = *name >= '0' && *name <= '9' ? atoi(name) : 0;		// to create "constant variable"
+		vector_insert_last(compiler->values, (Pointer)(intptr_t)value);
+		vector_insert_last(compiler->names, name);
+		map_insert(compiler->variables, name, (Pointer)(intptr_t)variable);
 	}
 	return variable;
 }
 
-static Array create_or_get_array(String name, int size, Runtime runtime) {
-	Array array = map_find(runtime->arrays, name);
-	if(array == NULL) {
-		array = parser_alloc(1 + size, runtime);
-		array[0] = size;	// size
-		array++;		// point to the first element
-		map_insert(runtime->arrays, name, array);
+static Word create_or_get_array(String name, Compiler compiler) {
+	name = intern(name, compiler);
+	Word array = (intptr_t)map_find(compiler->arrays, name);
+	if(array == 0) {
+		array = WORD(TAG_ARRAY, compiler->array_n++);
+		vector_insert_last(compiler->array_names, name);
+		map_insert(compiler->arrays, name, (Pointer)(intptr_t)array);
 	}
 	return array;
 }
 
-// add an argument to the instruction instr (if not null)
-static void instr_add_arg(BCInstruction instr, int* arg) {
+// Narrow arrays, declared as  new byte|short|bit a[n]. An array has the same type in all
+// its new statements, so its elements' type is known statically.
+
+// bits of the element type, 0 if type is not one
+static int type_bits(String type) {
+	return
+		strcmp(type, "bit") == 0 ? 1 :
+		strcmp(type, "byte") == 0 ? 8 :
+		strcmp(type, "short") == 0 ? 16 :
+		strcmp(type, "int") == 0 ? 32 :
+		0;
+}
+
+static int array_bits(String array, Compiler compiler) {
+	int bits = (intptr_t)map_find(compiler->array_bits, array);
+	return bits != 0 ? bits : 32;
+}
+
+// bits of the elements of token a[x] (without modifying it), 0 if token is not an element
+static int element_bits(String token, Compiler compiler) {
+	String bracket = token != NULL ? strchr(token, '[') : NULL;
+	if(bracket == NULL)
+		return 0;
+	char array[bracket - token + 1];
+	memcpy(array, token, bracket - token);
+	array[bracket - token] = '\0';
+	return array_bits(array, compiler);
+}
+
+// records the type of new's token a[n]
+static void declare_array(String token, int bits, Compiler compiler) {
+	String bracket = strchr(token, '[');
+	*bracket = '\0';
+	String array = intern(token, compiler);
+	*bracket = '[';
+
+	int declared = (intptr_t)map_find(compiler->array_bits, array);
+	if(declared != 0 && declared != bits)
+		compile_error(compiler, "array %s is declared with different types", array);
+	map_insert(compiler->array_bits, array, (Pointer)(intptr_t)bits);
+}
+
+// add an argument to the instruction instr (if not 0)
+static void instr_add_arg(BCInstruction instr, Word arg) {
 	if(arg)
 		instr->args[instr->arg_n++] = arg;
 }
 
-static BCInstruction create_bc_instruction(Opcode opcode, int n, int* variable, Array array) {
-	BCInstruction instr = calloc(1, sizeof(*instr));
+static BCInstruction create_bc_instruction(Opcode opcode, int n, Word variable, Word array, Compiler compiler) {
+	BCInstruction instr = arena_alloc(compiler->arena, sizeof(*instr));
 	instr->opcode = opcode;
 	instr->n = n;
 	instr->arg_n = 0;
+	instr->line = compiler->line;
 	instr_add_arg(instr, variable);
 	instr_add_arg(instr, array);
 	return instr;
 }
 
-static void create_load_varexpr(int reg, String token, Runtime runtime) {
+static void create_load_varexpr(int reg, String token, Compiler compiler) {
 	String index = array_index(token);
 
 	if(index) {
-		BCInstruction load_array = create_bc_instruction(0, -1, NULL, NULL);
+		BCInstruction load_array = create_bc_instruction(0, -1, 0, 0, compiler);
 		load_array->opcode = reg == 1 ? OP_LOAD1_A : OP_LOAD2_A;
-		instr_add_arg(load_array, create_or_get_variable(index, runtime));
-		instr_add_arg(load_array, create_or_get_array(token, 0, runtime));		// must be last
-		vector_insert_last(runtime->code, load_array);
+		instr_add_arg(load_array, create_or_get_variable(index, compiler));
+		instr_add_arg(load_array, create_or_get_array(token, compiler));		// must be last
+		vector_insert_last(compiler->code, load_array);
 
 	} else {
-		BCInstruction load_var = create_bc_instruction(reg == 1 ? OP_LOAD1_V : OP_LOAD2_V, -1, create_or_get_variable(token, runtime), NULL);
-		vector_insert_last(runtime->code, load_var);
+		BCInstruction load_var = create_bc_instruction(reg == 1 ? OP_LOAD1_V : OP_LOAD2_V, -1, create_or_get_variable(token, compiler), 0, compiler);
+		vector_insert_last(compiler->code, load_var);
 	}
 }
 
-static void create_store_varexpr(String token, Runtime runtime) {
+static void create_store_varexpr(String token, Compiler compiler) {
 	String index = array_index(token);
 
 	if(*token >= '0' && *token <= '9') {
-		printf("cannot store to constant %s\n", token);
-		exit(-1);
+		compile_error(compiler, "cannot store to constant %s", token);
 
 	} else if(index) {
-		BCInstruction store_array = create_bc_instruction(0, -1, NULL, NULL);
+		BCInstruction store_array = create_bc_instruction(0, -1, 0, 0, compiler);
 		store_array->opcode = OP_STORE_A;
-		store_array->args[store_array->arg_n++] = create_or_get_variable(index, runtime);
-		instr_add_arg(store_array, create_or_get_array(token, 0, runtime));	// must be last
+		store_array->args[store_array->arg_n++] = create_or_get_variable(index, compiler);
+		instr_add_arg(store_array, create_or_get_array(token, compiler));	// must be last
 
-		vector_insert_last(runtime->code, store_array);
+		vector_insert_last(compiler->code, store_array);
 
 	} else {
-		BCInstruction store_var = create_bc_instruction(OP_STORE_V, -1, create_or_get_variable(token, runtime), NULL);
-		vector_insert_last(runtime->code, store_var);
+		BCInstruction store_var = create_bc_instruction(OP_STORE_V, -1, create_or_get_variable(token, compiler), 0, compiler);
+		vector_insert_last(compiler->code, store_var);
 	}
 }
 
-static void instr_add_var_or_array(BCInstruction instr, String token, String index, Runtime runtime) {
+static void instr_add_var_or_array(BCInstruction instr, String token, String index, Compiler compiler) {
 	if(index) {
-		instr_add_arg(instr, create_or_get_variable(index, runtime));
-		instr_add_arg(instr, create_or_get_array(token, 0, runtime));
+		instr_add_arg(instr, create_or_get_variable(index, compiler));
+		instr_add_arg(instr, create_or_get_array(token, compiler));
 	} else {
-		instr_add_arg(instr, create_or_get_variable(token, runtime));
+		instr_add_arg(instr, create_or_get_variable(token, compiler));
 	}
 }
 
@@ -126,17 +213,17 @@ static String inverse_oper(String op) {
 		NULL;
 }
 
-static void create_expression(String x, String oper, String y, String target, Runtime runtime) {
+static void create_expression(String x, String oper, String y, String target, Compiler compiler) {
 	// operations without superinstructions
 	if(oper[0] == '*' || oper[0] == '/' || oper[0] == '%') {
-		create_load_varexpr(1, x, runtime);
-		create_load_varexpr(2, y, runtime);
+		create_load_varexpr(1, x, compiler);
+		create_load_varexpr(2, y, compiler);
 
-		vector_insert_last(runtime->code, create_bc_instruction(
+		vector_insert_last(compiler->code, create_bc_instruction(
 			oper[0] == '*' ? OP_MUL :
 			oper[0] == '/' ? OP_DIV :
 			oper[0] == '%' ? OP_MOD : -1,
-			-1, NULL, NULL
+			-1, 0, 0, compiler
 		));
 		return;
 	}
@@ -144,18 +231,29 @@ static void create_expression(String x, String oper, String y, String target, Ru
 	String x_index = array_index(x);
 	String y_index = array_index(y);
 
+	// there is no SUB with only x an array, x is first copied to a hidden variable
+	if(oper[0] == '-' && x_index && !y_index) {
+		BCInstruction load = create_bc_instruction(OP_ASSIGN_VA, -1, 0, 0, compiler);
+		vector_insert_last(compiler->code, load);
+		instr_add_var_or_array(load, x, x_index, compiler);
+		instr_add_arg(load, create_or_get_variable("!sub", compiler));
+		x = "!sub";
+		x_index = NULL;
+	}
+
 	// we swap x,y
 	//  - for >,>= (implemented as <,<=)
 	//  - for symmetric operatios, when only one of the two operands is an array
 	//
 	bool is_inequality = (oper[0] == '<' || oper[0] == '>');
-	if(oper[0] == '>' || (!is_inequality && x_index && !y_index)) {
+	if(oper[0] == '>' || (!is_inequality && oper[0] != '-' && x_index && !y_index)) {
 		// if only one is array, it should be y
 		String temp = y;
 		y = x;
 		x = temp;
+		temp = y_index;
 		y_index = x_index;
-		x_index = NULL;
+		x_index = temp;
 	}
 	Opcode opcode =
 		oper[0] == '+' ? OP_ADD_VVV :
@@ -166,45 +264,174 @@ static void create_expression(String x, String oper, String y, String target, Ru
 		OP_LE_VV;
 
 	// if the args are arrays, we advance the opcode to select the VA/AV/AA variants
-	opcode += (x_index ? 1 : 0) + (y_index ? 1 : 0) + (is_inequality && y_index ? 1 : 0);
+	opcode += (y_index ? 1 : 0) + (x_index ? (is_inequality ? 2 : 1) : 0);
 
-	BCInstruction add = create_bc_instruction(opcode, -1, NULL, NULL);
-	vector_insert_last(runtime->code, add);
-	instr_add_var_or_array(add, x, x_index, runtime);
-	instr_add_var_or_array(add, y, y_index, runtime);
+	BCInstruction add = create_bc_instruction(opcode, -1, 0, 0, compiler);
+	vector_insert_last(compiler->code, add);
+	instr_add_var_or_array(add, x, x_index, compiler);
+	instr_add_var_or_array(add, y, y_index, compiler);
 
 	if(oper[0] == '+' || oper[0] == '-') {
 		String target_index = array_index(target);
 		if(target_index)
 			add->opcode += 3;		// target is array, _A?? opcodes are 3 positions after the V?? ones
-		instr_add_var_or_array(add, target, target_index, runtime);
+		instr_add_var_or_array(add, target, target_index, compiler);
 	}
 }
 
 // target = x
-void create_assignment(String x, String target, Runtime runtime) {
+void create_assignment(String x, String target, Compiler compiler) {
 		String x_index = array_index(x);
 		String target_index = array_index(target);
 		Opcode opcode =
 				OP_ASSIGN_VV + (x_index ? 1 : 0) + (target_index ? 2 : 0);
 
-		BCInstruction assign = create_bc_instruction(opcode, -1, NULL, NULL);
-		vector_insert_last(runtime->code, assign);
-		instr_add_var_or_array(assign, x, x_index, runtime);
-		instr_add_var_or_array(assign, target, target_index, runtime);
+		BCInstruction assign = create_bc_instruction(opcode, -1, 0, 0, compiler);
+		vector_insert_last(compiler->code, assign);
+		instr_add_var_or_array(assign, x, x_index, compiler);
+		instr_add_var_or_array(assign, target, target_index, compiler);
+}
+
+// a single bulk instruction replaces the whole loop (or precedes it, for search)
+static void create_loop_idiom(LoopIdiom idiom, Compiler compiler) {
+	Opcode opcode =
+		idiom.kind == IDIOM_FILL ? OP_FILL :
+		idiom.kind == IDIOM_COPY ? OP_COPY :
+		idiom.kind == IDIOM_IOTA ? OP_IOTA :
+		idiom.kind == IDIOM_COUNT ? OP_COUNT_IF :
+		OP_SEARCH;
+	BCInstruction bulk = create_bc_instruction(opcode, -1, create_or_get_variable(idiom.counter, compiler), create_or_get_variable(idiom.bound, compiler), compiler);
+	instr_add_arg(bulk, create_or_get_variable(idiom.inclusive ? "1" : "0", compiler));
+	if(idiom.kind == IDIOM_COUNT || idiom.kind == IDIOM_SEARCH) {
+		char compare[4];
+		snprintf(compare, sizeof(compare), "%d", idiom.compare);
+		instr_add_arg(bulk, create_or_get_variable(compare, compiler));
+	}
+	if(idiom.kind == IDIOM_FILL || idiom.kind == IDIOM_COUNT || idiom.kind == IDIOM_SEARCH)
+		instr_add_arg(bulk, create_or_get_variable(idiom.source, compiler));
+	else if(idiom.kind == IDIOM_COPY)
+		instr_add_arg(bulk, create_or_get_array(idiom.source, compiler));
+	instr_add_arg(bulk, create_or_get_array(idiom.array, compiler));
+	if(idiom.kind == IDIOM_COUNT)
+		instr_add_arg(bulk, create_or_get_variable(idiom.acc, compiler));
+	vector_insert_last(compiler->code, bulk);
+}
+
+static void generate_statement_code(Statement stm, Compiler compiler);
+
+// the statements of a reduction loop's body that compute indexes
+static void create_index_statements(Statement loop, LoopIdiom idiom, Compiler compiler) {
+	for(Statement stm = loop->body; stm->next != NULL; stm = stm->next)		// the last one is the increment
+		if(stm != idiom.product && stm != idiom.update)
+			generate_statement_code(stm, compiler);
+}
+
+// A reduction loop is preceded by a bulk instruction that executes all its iterations but the
+// last, for which it needs the index of each read in the first iteration and its stride. They
+// are found by executing the index statements for counter and counter + 1 (which is skipped if
+// the loop does not run, the loop itself then computes the final values of the indexes).
+static void create_reduction_idiom(LoopIdiom idiom, String tok1, String tok2, String tok3, Compiler compiler, Statement loop) {
+	create_expression(tok1, tok2, tok3, NULL, compiler);
+	int skip_pos = vector_size(compiler->code) - 1;
+	BCInstruction skip = vector_get_at(compiler->code, skip_pos);
+
+	int read_n = idiom.kind == IDIOM_DOT ? 2 : 1;
+	String base[2], stride[2];
+	for(int i = 0; i < read_n; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "!base%d_%d", skip_pos, i);
+		base[i] = intern(name, compiler);
+		snprintf(name, sizeof(name), "!stride%d_%d", skip_pos, i);
+		stride[i] = intern(name, compiler);
+	}
+
+	Word counter = create_or_get_variable(idiom.counter, compiler);
+	create_index_statements(loop, idiom, compiler);
+	for(int i = 0; i < read_n; i++)
+		create_assignment(idiom.indexes[i], base[i], compiler);
+	vector_insert_last(compiler->code, create_bc_instruction(OP_INC_V, -1, counter, 0, compiler));
+	create_index_statements(loop, idiom, compiler);
+	for(int i = 0; i < read_n; i++)
+		create_expression(idiom.indexes[i], "-", base[i], stride[i], compiler);
+	vector_insert_last(compiler->code, create_bc_instruction(OP_DEC_V, -1, counter, 0, compiler));
+
+	Opcode opcode =
+		idiom.kind == IDIOM_SUM ? OP_SUM_V + (idiom.acc_index != NULL) :
+		idiom.kind == IDIOM_DOT ? OP_DOT_V + (idiom.acc_index != NULL) :
+		idiom.kind == IDIOM_MIN ? OP_MIN :
+		OP_MAX;
+	BCInstruction bulk = create_bc_instruction(opcode, -1, counter, create_or_get_variable(tok2[0] == '<' ? tok3 : tok1, compiler), compiler);
+	instr_add_arg(bulk, create_or_get_variable(idiom.inclusive ? "1" : "0", compiler));
+	for(int i = 0; i < read_n; i++) {
+		instr_add_arg(bulk, create_or_get_variable(base[i], compiler));
+		instr_add_arg(bulk, create_or_get_variable(stride[i], compiler));
+		instr_add_arg(bulk, create_or_get_array(idiom.reads[i], compiler));
+	}
+	if(idiom.acc_index != NULL) {
+		instr_add_arg(bulk, create_or_get_variable(idiom.acc_index, compiler));
+		instr_add_arg(bulk, create_or_get_array(idiom.acc, compiler));
+	} else {
+		instr_add_arg(bulk, create_or_get_variable(idiom.acc, compiler));
+	}
+	vector_insert_last(compiler->code, bulk);
+
+	skip->n = vector_size(compiler->code) - (skip_pos + 1);
+}
+
+// a[], the whole array
+static bool is_whole_array(String token) {
+	size_t length = token != NULL ? strlen(token) : 0;
+	return length > 2 && strcmp(token + length - 2, "[]") == 0;
+}
+
+// a[i], an element: a non-empty name and index, and no other brackets
+static bool is_element(String token) {
+	String bracket = strchr(token, '[');
+	size_t length = strlen(token);
+	return bracket != NULL && bracket != token && bracket + 2 < token + length &&
+		strpbrk(bracket + 1, "[]") == token + length - 1 && token[length - 1] == ']';
+}
+
+// tokens with brackets are elements, or whole arrays in the statements that take them
+// (eg "a[" or "a[]" as an element would crash code generation)
+static bool valid_brackets(String tokens[], int token_n, int type) {
+	bool whole = type == READ_ARRAY || type == WRITE_ARRAY || type == WRITELN_ARRAY || type == ARRAY_ASSIGN;
+	for(int i = 0; i < token_n; i++)
+		if(tokens[i] != NULL && strpbrk(tokens[i], "[]") != NULL && !is_element(tokens[i]) &&
+		   !(whole && is_whole_array(tokens[i]) && strpbrk(tokens[i], "[]") == tokens[i] + strlen(tokens[i]) - 2))
+			return false;
+	return true;
+}
+
+// the operands of  a[] = x <op> y  are scalars or whole arrays, not elements
+static bool valid_array_operands(String tokens[], int token_n) {
+	for(int i = 2; i < token_n; i += 2)
+		if(strchr(tokens[i], '[') != NULL && !is_whole_array(tokens[i]))
+			return false;
+	return true;
+}
+
+// the array of a whole-array operand a[], these work on int arrays only
+static Word whole_array(String token, Compiler compiler) {
+	token[strlen(token) - 2] = '\0';
+	if(array_bits(token, compiler) != 32)
+		compile_error(compiler, "array %s is not an int array", token);
+	return create_or_get_array(token, compiler);
 }
 
 static int find_type(String tokens[], int token_n) {
+	bool whole = token_n > 1 && is_whole_array(tokens[1]);
 	return
-		strcmp(tokens[0], "write") == 0 ? WRITE :
-		strcmp(tokens[0], "writeln") == 0 ? WRITELN :
-		strcmp(tokens[0], "read") == 0 ? READ:
+		strcmp(tokens[0], "write") == 0 ? (whole ? WRITE_ARRAY : WRITE) :
+		strcmp(tokens[0], "writeln") == 0 ? (whole ? WRITELN_ARRAY : WRITELN) :
+		strcmp(tokens[0], "read") == 0 ? (whole ? READ_ARRAY : READ) :
+		(token_n == 3 || token_n == 5) && strcmp(tokens[1], "=") == 0 && is_whole_array(tokens[0]) ? ARRAY_ASSIGN :
 		token_n == 3 && strcmp(tokens[1], "=") == 0 ? ASSIGN_VAR :
 		token_n == 5 && strcmp(tokens[1], "=") == 0 ? ASSIGN_EXP :
 		strcmp(tokens[0], "if") == 0 ? IF :
 		strcmp(tokens[0], "while") == 0 ? WHILE :
 		strcmp(tokens[0], "random") == 0 ? RAND :
-		strcmp(tokens[0], "argument") == 0 && strcmp(tokens[1], "size") == 0 ? ARG_SIZE :
+		strcmp(tokens[0], "argument") == 0 && token_n > 1 && strcmp(tokens[1], "size") == 0 ? ARG_SIZE :
 		strcmp(tokens[0], "argument") == 0 ? ARG :
 		strcmp(tokens[0], "break") == 0 ? BREAK :
 		strcmp(tokens[0], "continue") == 0 ? CONTINUE :
@@ -214,10 +441,140 @@ static int find_type(String tokens[], int token_n) {
 		-1;
 }
 
-static void generate_program_code(Program prog, Runtime runtime);
+// minimum number of tokens of each statement type
+static int min_tokens[] = {
+	[WRITE] = 2, [WRITELN] = 2, [READ] = 2, [ASSIGN_VAR] = 3, [ASSIGN_EXP] = 5,
+	[WHILE] = 4, [IF] = 4, [RAND] = 2, [ARG_SIZE] = 3, [ARG] = 3,
+	[BREAK] = 1, [CONTINUE] = 1, [NEW] = 2, [FREE] = 2, [SIZE] = 3,
+	[READ_ARRAY] = 2, [WRITE_ARRAY] = 2, [WRITELN_ARRAY] = 2, [ARRAY_ASSIGN] = 3,
+};
+
+// Positions of the tokens that a statement reads (set in reads, -1 if none) and of the one
+// it assigns (returned, -1 if none). Other tokens can only be scalars.
+static int operand_positions(Statement stm, int reads[2]) {
+	reads[0] = reads[1] = -1;
+	switch(stm->type) {
+		case WRITE:
+		case WRITELN:		reads[0] = 1;					return -1;
+		case READ:
+		case RAND:											return 1;
+		case ASSIGN_VAR:	reads[0] = 2;					return 0;
+		case ASSIGN_EXP:	reads[0] = 2; reads[1] = 4;		return 0;
+		case IF:
+		case WHILE:			reads[0] = 1; reads[1] = 3;		return -1;
+		case ARG:
+		case ARG_SIZE:
+		case SIZE:											return 2;
+		default:											return -1;
+	}
+}
+
+// An element of a narrow array is accessed by OP_LOAD_* / OP_STORE_* through a hidden variable
+typedef struct {
+	String array, index, var;
+	int bits;
+} NarrowElement;
+
+// Replaces the narrow elements in stm's tokens by hidden variables. Returns the number of read
+// ones, stored in loads, and the assigned one in *store (store->array == NULL if none).
+static int replace_narrow_elements(Statement stm, NarrowElement loads[2], NarrowElement* store, Compiler compiler) {
+	static String load_vars[] = { "!load0", "!load1" };
+	int reads[2];
+	int target = operand_positions(stm, reads);
+	int load_n = 0;
+
+	for(int k = 0; k < 2 && reads[k] != -1; k++) {
+		String* token = &stm->tokens[reads[k]];
+		int bits = element_bits(*token, compiler);
+		if(bits != 0 && bits != 32) {
+			String index = array_index(*token);
+			loads[load_n] = (NarrowElement){ *token, index, load_vars[load_n], bits };
+			*token = load_vars[load_n++];
+		}
+	}
+
+	*store = (NarrowElement){ NULL };
+	int bits = target != -1 ? element_bits(stm->tokens[target], compiler) : 0;
+	if(bits != 0 && bits != 32) {
+		String index = array_index(stm->tokens[target]);
+		*store = (NarrowElement){ stm->tokens[target], index, "!store", bits };
+		stm->tokens[target] = store->var;
+	}
+	return load_n;
+}
+
+static void create_narrow_loads(NarrowElement loads[], int load_n, Compiler compiler) {
+	for(int k = 0; k < load_n; k++) {
+		NarrowElement e = loads[k];
+		Opcode opcode = e.bits == 8 ? OP_LOAD_BYTE : e.bits == 16 ? OP_LOAD_SHORT : OP_LOAD_BIT;
+		BCInstruction load = create_bc_instruction(opcode, -1, create_or_get_variable(e.index, compiler), create_or_get_array(e.array, compiler), compiler);
+		instr_add_arg(load, create_or_get_variable(e.var, compiler));
+		vector_insert_last(compiler->code, load);
+	}
+}
+
+static void create_narrow_store(NarrowElement e, Compiler compiler) {
+	Opcode opcode = e.bits == 8 ? OP_STORE_BYTE : e.bits == 16 ? OP_STORE_SHORT : OP_STORE_BIT;
+	BCInstruction store = create_bc_instruction(opcode, -1, create_or_get_variable(e.var, compiler), create_or_get_variable(e.index, compiler), compiler);
+	instr_add_arg(store, create_or_get_array(e.array, compiler));
+	vector_insert_last(compiler->code, store);
+}
+
+// whether prog assigns elements of bit arrays, which share their bytes (so parallel
+// iterations cannot write them)
+static bool assigns_bits(Program prog, Compiler compiler) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
+		int reads[2];
+		int target = operand_positions(stm, reads);
+		if((target != -1 && element_bits(stm->tokens[target], compiler) == 1) ||
+		   assigns_bits(stm->body, compiler) || assigns_bits(stm->else_body, compiler))
+			return true;
+	}
+	return false;
+}
+
+// bulk instructions only work on int arrays
+static bool narrow_idiom(LoopIdiom idiom, Compiler compiler) {
+	String arrays[] = {
+		idiom.kind <= IDIOM_COUNT || idiom.kind == IDIOM_SEARCH ? idiom.array : NULL,
+		idiom.kind == IDIOM_COPY ? idiom.source : NULL,
+		idiom.reads[0],
+		idiom.reads[1],
+		idiom.acc_index != NULL ? idiom.acc : NULL,
+	};
+	for(int k = 0; k < 5; k++)
+		if(arrays[k] != NULL && array_bits(arrays[k], compiler) != 32)
+			return true;
+	return false;
+}
+
+static void generate_program_code(Program prog, Compiler compiler);
+
+static void generate_statement_code(Statement stm, Compiler compiler) {
+	// the body's statements restore the line, for the code after it (eg the while's test)
+	int outer_line = compiler->line;
+	compiler->line = stm->line;
+	int first_pos = vector_size(compiler->code);
+
+	// prefetches are placed before the statement's code, they need no jumps
+	for(Prefetch p = stm->prefetch; p != NULL; p = p->next) {
+		if(array_bits(p->array, compiler) != 32)
+			continue;
+		char prev[32];
+		snprintf(prev, sizeof(prev), "!prev%d", vector_size(compiler->code));
+		BCInstruction prefetch = create_bc_instruction(OP_PREFETCH, -1, create_or_get_variable(p->index, compiler), create_or_get_variable(prev, compiler), compiler);
+		instr_add_arg(prefetch, create_or_get_array(p->array, compiler));
+		vector_insert_last(compiler->code, prefetch);
+	}
+
+	stm->start_pos = vector_size(compiler->code);
+
+	// loads before the statement (for WHILE before each test), the store after it
+	NarrowElement loads[2], store;
+	int load_n = replace_narrow_elements(stm, loads, &store, compiler);
+	if(stm->type != WHILE)
+		create_narrow_loads(loads, load_n, compiler);
 
-static void generate_statement_code(Statement stm, Runtime runtime) {
-	stm->start_pos = vector_size(runtime->code);
 	String tok0 = stm->tokens[0];
 	String tok1 = stm->tokens[1];
 	String tok2 = stm->tokens[2];
@@ -227,22 +584,25 @@ static void generate_statement_code(Statement stm, Runtime runtime) {
 	switch(stm->type) {
 		case WRITE:
 		case WRITELN:
-			create_load_varexpr(1, tok1, runtime);
-			vector_insert_last(runtime->code, create_bc_instruction(stm->type == WRITE ? OP_WRITE : OP_WRITELN, -1, NULL, NULL));
+			create_load_varexpr(1, tok1, compiler);
+			vector_insert_last(compiler->code, create_bc_instruction(stm->type == WRITE ? OP_WRITE : OP_WRITELN, -1, 0, 0, compiler));
 			break;
 
 		case READ:
 		case RAND:
-			vector_insert_last(runtime->code, create_bc_instruction(stm->type == READ ? OP_READ : OP_RAND, -1, NULL, NULL));
-			create_store_varexpr(tok1, runtime);
+			vector_insert_last(compiler->code, create_bc_instruction(stm->type == READ ? OP_READ : OP_RAND, -1, 0, 0, compiler));
+			create_store_varexpr(tok1, compiler);
 			break;
 
 		case ASSIGN_VAR:
-			//  create_load_varexpr(1, tok2, runtime);
-			//  create_store_varexpr(tok0, runtime);
+			//  create_load_varexpr(1, tok2, compiler);
+			//  create_store_varexpr(tok0, compiler);
 			// tok3 = "+";
 			// tok4 = "0";
-			create_assignment(tok2, tok0, runtime);
+			if(store.array != NULL && strchr(tok2, '[') == NULL)
+				store.var = tok2;		// stored directly
+			else
+				create_assignment(tok2, tok0, compiler);
 			break;
 
 		case ASSIGN_EXP:
@@ -255,44 +615,92 @@ static void generate_statement_code(Statement stm, Runtime runtime) {
 					*bracket = '\0';
 					index[strlen(index)-1] = '\0';
 				}
-				int* array = bracket ? create_or_get_array(tok0, 0, runtime) : NULL;
-				int* var = create_or_get_variable(bracket ? index : tok0, runtime);
+				Word array = bracket ? create_or_get_array(tok0, compiler) : 0;
+				Word var = create_or_get_variable(bracket ? index : tok0, compiler);
 				int opcode = tok3[0] == '+' 
 					? (bracket ? OP_INC_A : OP_INC_V)
 					: (bracket ? OP_DEC_A : OP_DEC_V);
-				vector_insert_last(runtime->code, create_bc_instruction(opcode, -1, var, array));
+				vector_insert_last(compiler->code, create_bc_instruction(opcode, -1, var, array, compiler));
 
 			} else {
-				create_expression(tok2, tok3, tok4, tok0, runtime);
+				create_expression(tok2, tok3, tok4, tok0, compiler);
 				// ADD/SUB opcodes include the assignment
 				if(tok3[0] != '+' && tok3[0] != '-')
-					create_store_varexpr(tok0, runtime);
+					create_store_varexpr(tok0, compiler);
 			}
 			break;
 
 		case IF:
 		case WHILE: {
+			double start = now();
+			LoopIdiom idiom = stm->type == WHILE ? idiom_match(stm, compiler->arena) : (LoopIdiom){ IDIOM_NONE };
+			compiler->idiom_time += now() - start;
+			if(load_n > 0 || narrow_idiom(idiom, compiler))
+				idiom.kind = IDIOM_NONE;
+			if(idiom.kind >= IDIOM_FILL && idiom.kind <= IDIOM_COUNT) {
+				create_loop_idiom(idiom, compiler);
+				break;
+			}
+			if(idiom.kind == IDIOM_SEARCH) {
+				create_loop_idiom(idiom, compiler);
+				stm->start_pos = vector_size(compiler->code);
+			}
+			if(stm->type == WHILE && idiom.kind == IDIOM_NONE) {
+				start = now();
+				idiom_prefetch(stm, compiler->arena);
+				compiler->idiom_time += now() - start;
+			}
+
+			// a parallel loop is preceded by OP_PARALLEL and its reductions. The loop tests the
+			// counter against a copy of the bound, so that each thread can run part of the range.
+			BCInstruction parallel = NULL;
+			int parallel_pos = stm->start_pos;
+			if(stm->type == WHILE && stm->parallel != NULL && !assigns_bits(stm->body, compiler)) {
+				char copy[32];
+				snprintf(copy, sizeof(copy), "!bound%d", stm->start_pos);
+
+				parallel = create_bc_instruction(OP_PARALLEL, -1, create_or_get_variable(stm->parallel->counter, compiler), create_or_get_variable(stm->parallel->bound, compiler), compiler);
+				instr_add_arg(parallel, create_or_get_variable(copy, compiler));
+				instr_add_arg(parallel, create_or_get_variable(stm->parallel->inclusive ? "1" : "0", compiler));
+				vector_insert_last(compiler->code, parallel);
+				for(Reduction r = stm->parallel->reductions; r != NULL; r = r->next)
+					vector_insert_last(compiler->code, create_bc_instruction(r->mul ? OP_REDUCE_MUL : OP_REDUCE_ADD, -1, create_or_get_variable(r->var, compiler), 0, compiler));
+
+				if(strcmp(tok1, stm->parallel->bound) == 0)
+					tok1 = intern(copy, compiler);
+				else
+					tok3 = intern(copy, compiler);
+				stm->start_pos = vector_size(compiler->code);		// continue jumps to the loop itself
+			}
+
+			if(idiom.kind >= IDIOM_SUM && idiom.kind <= IDIOM_MAX) {
+				create_reduction_idiom(idiom, tok1, tok2, tok3, compiler, stm);
+				stm->start_pos = vector_size(compiler->code);
+			}
+
 			// the jump offset will be filled after generating the body code
 			BCInstruction jump_over_body = NULL;
 
 			bool always_true = strcmp(tok1, tok3) == 0 && strcmp(tok2, "==") == 0;
+			if(stm->type == WHILE)
+				create_narrow_loads(loads, load_n, compiler);
 			if(!always_true) {
 				// test instrutions (eg OP_EQ_VV) do a test&jump, no separate jump is needed!
-				create_expression(tok1, tok2, tok3, NULL, runtime);
-				jump_over_body = vector_get_at(runtime->code, vector_size(runtime->code)-1);  // last instr is the test&jump
+				create_expression(tok1, tok2, tok3, NULL, compiler);
+				jump_over_body = vector_get_at(compiler->code, vector_size(compiler->code)-1);  // last instr is the test&jump
 			}
 
 			// generate the body code
-			int guard_length = vector_size(runtime->code) - stm->start_pos;
-			generate_program_code(stm->body, runtime);
+			int guard_length = vector_size(compiler->code) - stm->start_pos;
+			generate_program_code(stm->body, compiler);
 
  			// if we have a WHILE, a jump back to start should be added at the end of the body
 			BCInstruction jump_back_to_start = NULL;
 			if(stm->type == WHILE) {
 				if(always_true) {
 					// infinite loop, we do an unconditional jump back
-					jump_back_to_start = create_bc_instruction(OP_JUMP, -1, NULL, NULL);
-					vector_insert_last(runtime->code, jump_back_to_start);
+					jump_back_to_start = create_bc_instruction(OP_JUMP, -1, 0, 0, compiler);
+					vector_insert_last(compiler->code, jump_back_to_start);
 				} else {
 					// normal loop with a test
 					// __Optimization__: instead of jumping back to start, and then
@@ -302,20 +710,21 @@ static void generate_statement_code(Statement stm, Runtime runtime) {
 					//    while(cond} { ...  }
 					// to
 					//    if(cond) { do { ... } while(code) }
-					create_expression(tok1, inverse_oper(tok2), tok3, NULL, runtime);
-					jump_back_to_start = vector_get_at(runtime->code, vector_size(runtime->code)-1);
+					create_narrow_loads(loads, load_n, compiler);
+					create_expression(tok1, inverse_oper(tok2), tok3, NULL, compiler);
+					jump_back_to_start = vector_get_at(compiler->code, vector_size(compiler->code)-1);
 				}
 			}
 
 			// if we have an else we need to jump over it at the end of body
 			BCInstruction jump_over_else = NULL;
 			if(stm->else_body) {
-				jump_over_else = create_bc_instruction(OP_JUMP, -1, NULL, NULL);
-				vector_insert_last(runtime->code, jump_over_else);
+				jump_over_else = create_bc_instruction(OP_JUMP, -1, 0, 0, compiler);
+				vector_insert_last(compiler->code, jump_over_else);
 			}
 
 			// now we can jump over the body
-			int body_length = vector_size(runtime->code) - stm->start_pos - guard_length;
+			int body_length = vector_size(compiler->code) - stm->start_pos - guard_length;
 			if(jump_over_body != NULL)
 				jump_over_body->n = body_length;
 
@@ -326,73 +735,123 @@ static void generate_statement_code(Statement stm, Runtime runtime) {
 
 			// add the else code, if it exists
 			if(stm->else_body) {
-				generate_program_code(stm->else_body, runtime);
+				generate_program_code(stm->else_body, compiler);
 
 				// at the end of the body we jump over else
-				int else_length = vector_size(runtime->code) - stm->start_pos - body_length - guard_length;
+				int else_length = vector_size(compiler->code) - stm->start_pos - body_length - guard_length;
 				jump_over_else->n = else_length;
 			}
+
+			// OP_PARALLEL jumps after the loop
+			if(parallel != NULL)
+				parallel->n = vector_size(compiler->code) - (parallel_pos + 1);
 			break;
 		}
 
 		case BREAK:
 		case CONTINUE:
 			// the exact jump will be filled later
-			vector_insert_last(runtime->code, create_bc_instruction(OP_JUMP, -1, NULL, NULL));
+			vector_insert_last(compiler->code, create_bc_instruction(OP_JUMP, -1, 0, 0, compiler));
 			break;
 
-		case NEW: {
-			Array array = create_or_get_array(strtok(tok1, "[]"), 0, runtime);
-			create_load_varexpr(1, strtok(NULL, "[]"), runtime);
-			vector_insert_last(runtime->code, create_bc_instruction(OP_NEW, -1, NULL, array));
+		case NEW:
+		case FREE: {
+			String saveptr;
+			String name = strtok_r(tok1, "[]", &saveptr);
+			Word array = create_or_get_array(name, compiler);
+			char bits[4];
+			snprintf(bits, sizeof(bits), "%d", array_bits(name, compiler));
+			if(stm->type == NEW)
+				create_load_varexpr(1, strtok_r(NULL, "[]", &saveptr), compiler);
+			vector_insert_last(compiler->code, create_bc_instruction(stm->type == NEW ? OP_NEW : OP_FREE, -1, create_or_get_variable(bits, compiler), array, compiler));
 			break;
 		}
 
-		case FREE: {
-			Array array = create_or_get_array(tok1, 0, runtime);
-			vector_insert_last(runtime->code, create_bc_instruction(OP_FREE, -1, NULL, array));
+		// a single instruction reads/writes all elements
+		case READ_ARRAY:
+		case WRITE_ARRAY:
+		case WRITELN_ARRAY: {
+			tok1[strlen(tok1) - 2] = '\0';
+			char bits[4];
+			snprintf(bits, sizeof(bits), "%d", array_bits(tok1, compiler));
+			Opcode opcode = stm->type == READ_ARRAY ? OP_READ_ARRAY : stm->type == WRITE_ARRAY ? OP_WRITE_ARRAY : OP_WRITELN_ARRAY;
+			vector_insert_last(compiler->code, create_bc_instruction(opcode, -1, create_or_get_variable(bits, compiler), create_or_get_array(tok1, compiler), compiler));
+			break;
+		}
+
+		case ARRAY_ASSIGN: {
+			// a[] = x  is  a[] = x + 0
+			String ops[] = { "+", "-", "*", "==", "!=", "<", "<=", ">", ">=" };
+			int op = 0;
+			while(tok3 != NULL && strcmp(ops[op], tok3) != 0)
+				op++;
+
+			Word operands[2];
+			int form = op * 4;
+			String tokens[] = { tok2, tok4 != NULL ? tok4 : "0" };
+			for(int i = 0; i < 2; i++) {
+				if(is_whole_array(tokens[i])) {
+					operands[i] = whole_array(tokens[i], compiler);
+					form += 1 << i;
+				} else {
+					operands[i] = create_or_get_variable(tokens[i], compiler);
+				}
+			}
+
+			char form_const[12];
+			snprintf(form_const, sizeof(form_const), "%d", form);
+			BCInstruction array_op = create_bc_instruction(OP_ARRAY_OP, -1, create_or_get_variable(form_const, compiler), operands[0], compiler);
+			instr_add_arg(array_op, operands[1]);
+			instr_add_arg(array_op, whole_array(tok0, compiler));
+			vector_insert_last(compiler->code, array_op);
 			break;
 		}
 
 		case SIZE:
 		case ARG_SIZE: {
-			Array array = create_or_get_array(stm->type == SIZE ? tok1 : "!args", 0, runtime);
-			vector_insert_last(runtime->code, create_bc_instruction(OP_SIZE, -1, NULL, array));
-			create_store_varexpr(tok2, runtime);
+			Word array = create_or_get_array(stm->type == SIZE ? tok1 : "!args", compiler);
+			vector_insert_last(compiler->code, create_bc_instruction(OP_SIZE, -1, 0, array, compiler));
+			create_store_varexpr(tok2, compiler);
 			break;
 		}
 
 		case ARG: {
-			// create_load_varexpr(1, tok1, runtime);
+			// create_load_varexpr(1, tok1, compiler);
 
-			BCInstruction load_array = create_bc_instruction(OP_LOAD1_A, -1, create_or_get_variable(tok1, runtime), create_or_get_array("!args", 0, runtime));
-			vector_insert_last(runtime->code, load_array);
+			BCInstruction load_array = create_bc_instruction(OP_LOAD1_A, -1, create_or_get_variable(tok1, compiler), create_or_get_array("!args", compiler), compiler);
+			vector_insert_last(compiler->code, load_array);
 
-			BCInstruction store_var = create_bc_instruction(OP_STORE_V, -1, create_or_get_variable(tok2, runtime), NULL);
-			vector_insert_last(runtime->code, store_var);
+			BCInstruction store_var = create_bc_instruction(OP_STORE_V, -1, create_or_get_variable(tok2, compiler), 0, compiler);
+			vector_insert_last(compiler->code, store_var);
 			break;
 		}
 	}
 
-	stm->end_pos = vector_size(runtime->code);
-}
+	if(store.array != NULL)
+		create_narrow_store(store, compiler);
+	stm->end_pos = vector_size(compiler->code);
 
-static void generate_program_code(Program prog, Runtime runtime) {
-	for(int i = 0; i < vector_size(prog); i++)
-		generate_statement_code(vector_get_at(prog, i), runtime);
+	if(stm->type == WHILE) {
+		LoopRange* loop = arena_alloc(compiler->arena, sizeof(*loop));
+		*loop = (LoopRange){ first_pos, stm->end_pos, stm->line };
+		vector_insert_last(compiler->loops, loop);
+	}
+	compiler->line = outer_line;
 }
 
-static void set_break_continue_offsets(Program prog, Runtime runtime, Vector while_stack) {
-	for(int i = 0; i < vector_size(prog); i++) {
-		Statement stm = vector_get_at(prog, i);
+static void generate_program_code(Program prog, Compiler compiler) {
+	for(Statement stm = prog; stm != NULL; stm = stm->next)
+		generate_statement_code(stm, compiler);
+}
 
+static void set_break_continue_offsets(Program prog, Compiler compiler) {
+	Vector while_stack = compiler->while_stack;
+	for(Statement stm = prog; stm != NULL; stm = stm->next) {
 		if(stm->type == BREAK || stm->type == CONTINUE) {
-			BCInstruction jump = vector_get_at(runtime->code, stm->start_pos);
+			BCInstruction jump = vector_get_at(compiler->code, stm->start_pos);
 			int levels = stm->tokens[1] ? atoi(stm->tokens[1]) : 1;
-			if(levels > vector_size(while_stack)) {
-				printf("invalid break/continue\n");
-				exit(-1);
-			}
+			if(levels < 1 || levels > vector_size(while_stack))
+				compile_error(compiler, "invalid break/continue");
 			Statement while_stm = vector_get_at(while_stack, vector_size(while_stack) - levels);
 			jump->n = (stm->type == BREAK ? while_stm->end_pos : while_stm->start_pos) - (stm->start_pos + 1);	// +1 cause the IP is after the break
 		}
@@ -401,45 +860,52 @@ static void set_break_continue_offsets(Program prog, Runtime runtime, Vector whi
 			vector_insert_last(while_stack, stm);
 
 		if(stm->body)
-			set_break_continue_offsets(stm->body, runtime, while_stack);
+			set_break_continue_offsets(stm->body, compiler);
 		if(stm->else_body)
-			set_break_continue_offsets(stm->else_body, runtime, while_stack);
+			set_break_continue_offsets(stm->else_body, compiler);
 
 		if(stm->type == WHILE)
 			vector_remove_last(while_stack);
 	}
 }
 
-static Vector get_nested_source(Vector source, int start) {
-	Vector nested = vector_create(0, NULL);
-	for(int i = start; i < vector_size(source); i++) {
-		String line = vector_get_at(source, i);
-		if(line[0] != '\t' && line[0] != '\0' && line[0] != '#' && line[0] != '\n'&& line[0] != '\r')
-			break;
-		vector_insert_last(nested, line + (line[0] == '\t' ? 1 : 0));	// skip initial tab
-	}
-	return nested;
-}
-
-static void destroy_statement(Pointer p) {
-	Statement stm = p;
-	if(stm->body)
-		vector_destroy(stm->body);
-	if(stm->else_body)
-		vector_destroy(stm->else_body);
-	free(p);
-}
+// Single pass over the source. compiler->links holds the currently open bodies, links[k] is
+// where the next statement at nesting level k (lines starting with k tabs) is stored,
+// and lasts[k] the last statement added to that level. Empty lines and comments
+// never close a block, any other line closes all blocks deeper than its indentation.
+// Extra indentation is ignored, the line simply belongs to the innermost open block.
+//
+static Program parse(Vector source, Compiler compiler) {
+	Program prog = NULL;
 
-static Program parse(Vector source, Runtime runtime) {
-	Program prog = vector_create(0, destroy_statement);
+	Vector links = compiler->links;
+	Vector lasts = compiler->lasts;
+	vector_insert_last(links, &prog);
+	vector_insert_last(lasts, NULL);
 
 	for(int i = 0; i < vector_size(source); i++) {
 		String line = vector_get_at(source, i);
 
+		int tabs = 0;
+		while(line[tabs] == '\t')
+			tabs++;
+
+		char first = line[tabs];
+		if(first != '\0' && first != '#' && first != '\n' && first != '\r') {
+			while(vector_size(links) > tabs + 1) {
+				vector_remove_last(links);
+				vector_remove_last(lasts);
+			}
+		}
+
+		int level = vector_size(links) - 1;
+		Statement last = vector_get_at(lasts, level);
+
 		// split in tokens
 		String tokens[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
 		int token_n = 0;
-		for(String token = strtok(line, " \t\n\r"); token_n < 6 && token != NULL && token[0] != '#'; token = strtok(NULL, " \t\n\r"))
+		String saveptr;
+		for(String token = strtok_r(line, " \t\n\r", &saveptr); token_n < 6 && token != NULL && token[0] != '#'; token = strtok_r(NULL, " \t\n\r", &saveptr))
 			tokens[token_n++] = token;
 
 		if(token_n == 0)
@@ -447,30 +913,50 @@ static Program parse(Vector source, Runtime runtime) {
 
 		// else branches should be inserted in the last if statement
 		if(strcmp(tokens[0], "else") == 0) {
-			Vector nested = get_nested_source(source, i+1);
-			Statement stm = vector_get_at(prog, vector_size(prog) - 1);
-			stm->else_body = parse(nested, runtime);
-			i += vector_size(nested);
-			vector_destroy(nested);
+			if(last == NULL)
+				compile_error(compiler, "error in line %s", line);
+			if(level >= PARSER_MAX_DEPTH)
+				compile_error(compiler, "error in line %d: nesting deeper than %d levels", i + 1, PARSER_MAX_DEPTH);
+			vector_insert_last(links, &last->else_body);
+			vector_insert_last(lasts, NULL);
 			continue;
 		}
 
+		// new <type> a[n], the type is removed so that tokens[1] is the array
 		int type = find_type(tokens, token_n);
-		if(type == -1) {
-			printf("error in line %s\n", line);
-			exit(1);
+		int bits = 32;
+		if(type == NEW && token_n > 2) {
+			bits = type_bits(tokens[1]);
+			tokens[1] = tokens[2];
+			tokens[2] = NULL;
 		}
-		Statement stm = calloc(1, sizeof(*stm));
+		if(type == -1 || token_n < min_tokens[type] || bits == 0 ||
+		   ((type == IF || type == WHILE) && inverse_oper(tokens[2]) == NULL) ||
+		   (type == ASSIGN_EXP && (strchr("+-*/%", tokens[3][0]) == NULL || tokens[3][1] != '\0')) ||
+		   (type == ARRAY_ASSIGN && token_n == 5 && (strchr("+-*", tokens[3][0]) == NULL || tokens[3][1] != '\0') && inverse_oper(tokens[3]) == NULL) ||
+		   (type == ARRAY_ASSIGN && !valid_array_operands(tokens, token_n)) ||
+		   (type == NEW && !is_element(tokens[1])) ||
+		   !valid_brackets(tokens, token_n, type))
+			compile_error(compiler, "error in line %s", line);
+		if(type == NEW)
+			declare_array(tokens[1], bits, compiler);
+
+		Statement stm = arena_alloc(compiler->arena, sizeof(*stm));
 		stm->type = type;
+		stm->line = i + 1;
 		memcpy(stm->tokens, tokens, 5*sizeof(String));
-		vector_insert_last(prog, stm);
 
-		// if/while have bodies
+		Statement* link = vector_get_at(links, level);
+		*link = stm;
+		vector_set_at(links, level, &stm->next);
+		vector_set_at(lasts, level, stm);
+
+		// if/while have bodies, the following lines go there
 		if(stm->type == IF || stm->type == WHILE) {
-			Vector nested = get_nested_source(source, i+1);
-			stm->body = parse(nested, runtime);
-			i += vector_size(nested);
-			vector_destroy(nested);
+			if(level >= PARSER_MAX_DEPTH)
+				compile_error(compiler, "error in line %d: nesting deeper than %d levels", i + 1, PARSER_MAX_DEPTH);
+			vector_insert_last(links, &stm->body);
+			vector_insert_last(lasts, NULL);
 		}
 	}
 
@@ -478,46 +964,196 @@ static Program parse(Vector source, Runtime runtime) {
 }
 
 static int compare_pointers(Pointer a, Pointer b) {
-	return a - b;
+	return a < b ? -1 : a > b;		// a - b does not fit in an int
+}
+
+// outer loops first, they start at or before their inner ones (and end after them)
+static int compare_loops(const void* a, const void* b) {
+	const LoopRange* x = a;
+	const LoopRange* y = b;
+	return x->start != y->start ? x->start - y->start : y->end - x->end;
 }
 
-Runtime parser_create_runtime(Vector source, Vector args, bool verbose) {
-	Runtime runtime = calloc(1, sizeof(*runtime));
-	runtime->variables = map_create((CompareFunc)strcmp, NULL, NULL);
-	runtime->arrays = map_create((CompareFunc)strcmp, NULL, NULL);
-	runtime->allocs = set_create(compare_pointers, free);
-	runtime->verbose = verbose;
+// Converts the code to the thread layout of a Bytecode
+static Bytecode assemble(Compiler compiler) {
+	Bytecode bytecode = calloc(1, sizeof(*bytecode));
+	bytecode->args_array = WORD_VALUE(create_or_get_array("!args", compiler));
+	bytecode->var_n = vector_size(compiler->values);
+	bytecode->array_n = compiler->array_n;
+
+	bytecode->values = malloc(bytecode->var_n * sizeof(*bytecode->values));
+	for(int i = 0; i < bytecode->var_n; i++)
+		bytecode->values[i] = (intptr_t)vector_get_at(compiler->values, i);
+
+	for(int i = 0; i < vector_size(compiler->array_names); i++)
+		vector_insert_last(compiler->names, vector_get_at(compiler->array_names, i));
+	for(int i = 0; i < vector_size(compiler->names); i++)
+		bytecode->names_size += strlen(vector_get_at(compiler->names, i)) + 1;
+	char* name = bytecode->names = malloc(bytecode->names_size);
+	for(int i = 0; i < vector_size(compiler->names); i++)
+		name = stpcpy(name, vector_get_at(compiler->names, i)) + 1;
+	parser_index_names(bytecode);
+
+	// thread position of each instruction, for the relative jumps
+	int instr_n = vector_size(compiler->code);
+	int* pos = malloc((instr_n + 1) * sizeof(*pos));
+	for(int i = 0; i < instr_n; i++) {
+		BCInstruction instr = vector_get_at(compiler->code, i);
+		pos[i] = bytecode->word_n;
+		bytecode->word_n += 1 + instr->arg_n + (is_jump(instr->opcode) ? 1 : 0);
+	}
+	pos[instr_n] = bytecode->word_n;
+
+	Word* w = bytecode->words = malloc(bytecode->word_n * sizeof(*bytecode->words));
+	bytecode->lines = malloc(bytecode->word_n * sizeof(*bytecode->lines));
+	for(int i = 0; i < instr_n; i++) {
+		BCInstruction instr = vector_get_at(compiler->code, i);
+		for(int j = pos[i]; j < pos[i + 1]; j++)
+			bytecode->lines[j] = instr->line;
+
+		*w++ = WORD(TAG_OPCODE, instr->opcode);
+		if(is_jump(instr->opcode))
+			*w++ = WORD(TAG_JUMP, pos[i + 1 + instr->n] - (pos[i] + 1));
+		for(int j = 0; j < instr->arg_n; j++)
+			*w++ = instr->args[j];
+	}
+
+	// loops are added when their code ends, so inner before outer
+	bytecode->loop_n = vector_size(compiler->loops);
+	bytecode->loops = malloc(bytecode->loop_n * sizeof(*bytecode->loops));
+	for(int i = 0; i < bytecode->loop_n; i++) {
+		LoopRange* loop = vector_get_at(compiler->loops, i);
+		bytecode->loops[i] = (LoopRange){ pos[loop->start], pos[loop->end], loop->line };
+	}
+	qsort(bytecode->loops, bytecode->loop_n, sizeof(*bytecode->loops), compare_loops);
 
-	// create "!args" array containing all arguments
-	Array args_arr = create_or_get_array("!args", vector_size(args)+1, runtime);
-	args_arr[-1] = vector_size(args);
-	for(int i = 0; i < args_arr[-1]; i++)
-		args_arr[i+1] = atoi(vector_get_at(args, i)); // i+1 cause argument command is 1-based
+	free(pos);
+	return bytecode;
+}
 
-	// parse
-	Program program = parse(source, runtime);
+Bytecode parser_compile(Vector source, bool parallel, String error) {
+	Compiler compiler = calloc(1, sizeof(*compiler));
+	compiler->arena = arena_create();
+	compiler->code = vector_create(0, NULL);
+	compiler->values = vector_create(0, NULL);
+	compiler->loops = vector_create(0, NULL);
+	compiler->names = vector_create(0, NULL);
+	compiler->array_names = vector_create(0, NULL);
+	compiler->links = vector_create(0, NULL);
+	compiler->lasts = vector_create(0, NULL);
+	compiler->while_stack = vector_create(0, NULL);
+	compiler->symbols = map_create((CompareFunc)strcmp, NULL, NULL);
+	compiler->variables = map_create(compare_pointers, NULL, NULL);
+	compiler->arrays = map_create(compare_pointers, NULL, NULL);
+	compiler->array_bits = map_create((CompareFunc)strcmp, NULL, NULL);
+	map_set_hash_function(compiler->symbols, hash_string);
+	map_set_hash_function(compiler->variables, hash_pointer);
+	map_set_hash_function(compiler->arrays, hash_pointer);
+	map_set_hash_function(compiler->array_bits, hash_string);
+	compiler->error = error;
+
+	// the hash is computed before parsing, which modifies the source lines
+	uint64_t source_hash = parser_source_hash(source);
+
+	Bytecode bytecode = NULL;
+	if(setjmp(compiler->on_error) == 0) {
+		// parse
+		CompileTimes times;
+		double start = now();
+		Program program = parse(source, compiler);
+		times.parse = now() - start;
+
+		// before code generation, which modifies the tokens
+		start = now();
+		if(parallel)
+			parallel_analyze(program, compiler->arena);
+		times.parallel = now() - start;
+
+		// generate bytecode (the idioms are matched during code generation)
+		start = now();
+		generate_program_code(program, compiler);
+		vector_insert_last(compiler->code, create_bc_instruction(OP_HALT, -1, 0, 0, compiler));
+		times.idioms = compiler->idiom_time;
+		times.codegen = now() - start - times.idioms;
+
+		// setup break/contunue
+		start = now();
+		set_break_continue_offsets(program, compiler);
+		times.jumps = now() - start;
+
+		start = now();
+		bytecode = assemble(compiler);
+		bytecode->source_hash = source_hash;
+		bytecode->parallel = parallel;
+		times.assemble = now() - start;
+		bytecode->compile_times = times;
+	}
 
-	// generate bytecode
-	runtime->code = vector_create(0, free);
-	generate_program_code(program, runtime);
-	vector_insert_last(runtime->code, create_bc_instruction(OP_HALT, -1, NULL, NULL));
+	// all compile-time data is released at once
+	map_destroy(compiler->variables);
+	map_destroy(compiler->arrays);
+	map_destroy(compiler->array_bits);
+	map_destroy(compiler->symbols);
+	vector_destroy(compiler->values);
+	vector_destroy(compiler->loops);
+	vector_destroy(compiler->names);
+	vector_destroy(compiler->array_names);
+	vector_destroy(compiler->code);
+	vector_destroy(compiler->links);
+	vector_destroy(compiler->lasts);
+	vector_destroy(compiler->while_stack);
+	arena_destroy(compiler->arena);
+	free(compiler);
+
+	return bytecode;
+}
 
-	// setup break/contunue
-	Vector while_stack = vector_create(0, NULL);
-	set_break_continue_offsets(program, runtime, while_stack);
-	vector_destroy(while_stack);
+// FNV-1a
+uint64_t parser_source_hash(Vector source) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(int i = 0; i < vector_size(source); i++)
+		for(unsigned char* c = (unsigned char*)vector_get_at(source, i); *c; c++)
+			hash = (hash ^ *c) * 0x100000001b3ULL;
+	return hash;
+}
 
-	// no longer needed
-	map_destroy(runtime->variables);
-	map_destroy(runtime->arrays);
-	vector_destroy(program);
-	runtime->variables = runtime->arrays = NULL;
+bool is_jump(Opcode opcode) {
+	return
+		opcode == OP_JUMP ||
+		opcode == OP_PARALLEL ||
+		(opcode >= OP_EQ_VV && opcode <= OP_LT_AA);
+}
 
-	return runtime;
+void parser_destroy_bytecode(Bytecode bytecode) {
+	if(bytecode->mapping != NULL) {
+		munmap(bytecode->mapping, bytecode->mapping_size);
+	} else {
+		free(bytecode->values);
+		free(bytecode->words);
+		free(bytecode->lines);
+		free(bytecode->loops);
+		free(bytecode->names);
+	}
+	free(bytecode->var_names);
+	free(bytecode->array_names);
+	free(bytecode);
 }
 
-void parser_destroy_runtime(Runtime runtime) {
-	set_destroy(runtime->allocs);
-	vector_destroy(runtime->code);
-	free(runtime);
+bool parser_index_names(Bytecode bytecode) {
+	bytecode->var_names = malloc(bytecode->var_n * sizeof(*bytecode->var_names));
+	bytecode->array_names = malloc(bytecode->array_n * sizeof(*bytecode->array_names));
+
+	char* name = bytecode->names;
+	char* end = bytecode->names + bytecode->names_size;
+	for(int i = 0; i < bytecode->var_n + bytecode->array_n; i++) {
+		char* terminator = name < end ? memchr(name, '\0', end - name) : NULL;
+		if(terminator == NULL)
+			return false;
+		if(i < bytecode->var_n)
+			bytecode->var_names[i] = name;
+		else
+			bytecode->array_names[i - bytecode->var_n] = name;
+		name = terminator + 1;
+	}
+	return name == end;
 }
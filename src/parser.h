@@ -1,16 +1,19 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+
 #include <ADTVector.h>
 #include <ADTMap.h>
 #include <ADTSet.h>
 
+#include "arena.h"
 
-extern int* memory;
 
 typedef char* String;
 
-typedef Vector Program;	// Vector of Statement
+typedef struct statement* Program;	// linked list of Statement
 
 typedef enum {
 	WRITE,			// write <var1>
@@ -28,99 +31,261 @@ typedef enum {
 	NEW,			// new <array>[var1]
 	FREE,			// free <array>
 	SIZE,			// size <array> <var1>
+	READ_ARRAY,		// read <array>[]      (all elements)
+	WRITE_ARRAY,	// write <array>[]
+	WRITELN_ARRAY,	// writeln <array>[]   (the last element is followed by a newline)
+	ARRAY_ASSIGN,	// <array>[] = <x>  or  <array>[] = <x> <op> <y>, x, y scalars or <array>[]
 } StatementType;
 
 typedef int* Array;
 
+// The instructions of the VM, OPCODES(X) expands to X(opcode) for each of them in order. The
+// enum, the names (see interpreter_opcode_name) and the dispatch tables of the interpreter are
+// generated from this single list.
+#define OPCODES(X) \
+	X(OP_WRITE)			/* write reg1 */ \
+	X(OP_WRITELN)		/* writeln reg1 */ \
+	X(OP_READ)			/* reg1 = read */ \
+	X(OP_LOAD1_V)		/* reg1 = <var> */ \
+	X(OP_LOAD1_A)		/* reg1 = <array>[<var>] */ \
+	X(OP_LOAD2_V)		/* reg2 = <var> */ \
+	X(OP_LOAD2_A)		/* reg2 = <array>[<var>] */ \
+	X(OP_STORE_V)		/* <var> = reg1 */ \
+	X(OP_STORE_A)		/* <array>[<var>] = reg1 */ \
+	X(OP_ASSIGN_VV) \
+	X(OP_ASSIGN_VA) \
+	X(OP_ASSIGN_AV) \
+	X(OP_ASSIGN_AA) \
+	X(OP_INC_V)			/* <var>++ */ \
+	X(OP_INC_A)			/* <array>[<var>]++ */ \
+	X(OP_DEC_V)			/* <var>-- */ \
+	X(OP_DEC_A)			/* <array>[<var>]-- */ \
+	X(OP_JUMP)			/* jump <n> */ \
+	X(OP_RAND)			/* reg1 = random */ \
+	X(OP_NEW)			/* <array> = malloc reg1 elements of <var> bits (the constant 1, 8, 16 or 32) */ \
+	X(OP_FREE)			/* free <array> of <var> bits */ \
+	X(OP_SIZE)			/* reg1 = size <array> */ \
+	X(OP_HALT)			/* stop execution */ \
+	X(OP_INTERRUPT)		/* stop execution, see interpreter_interrupt (not generated by the parser) */ \
+	X(OP_PARALLEL)		/* run the following loop in parallel and jump <n>, or set <var3> = <var2> (see parallel.h) */ \
+	X(OP_REDUCE_ADD)	/* <var> is a += reduction of the preceding OP_PARALLEL */ \
+	X(OP_REDUCE_MUL)	/* <var> is a *= reduction of the preceding OP_PARALLEL */ \
+	X(OP_FILL)			/* loop idioms (see idiom.h), args: counter, bound, <=, then value, array */ \
+	X(OP_COPY)			/*   source array, array */ \
+	X(OP_IOTA)			/*   array */ \
+	X(OP_COUNT_IF)		/*   comparison, value, array, count var */ \
+	X(OP_SEARCH)		/*   comparison, value, array */ \
+	X(OP_SUM_V)			/* reduction idioms, args: counter, bound, <=, index, stride, array, then accumulator var */ \
+	X(OP_SUM_A)			/*   accumulator index, array */ \
+	X(OP_DOT_V)			/*   index, stride, array (of the 2nd read), accumulator var */ \
+	X(OP_DOT_A)			/*   index, stride, array, accumulator index, array */ \
+	X(OP_MIN)			/*   accumulator var */ \
+	X(OP_MAX)			/*   accumulator var */ \
+	X(OP_PREFETCH)		/* prefetch <array>[<var1>] some iterations ahead, <var2> holds <var1> of the previous one */ \
+	X(OP_LOAD_BYTE)		/* <var2> = <array>[<var1>], of a byte array */ \
+	X(OP_STORE_BYTE)	/* <array>[<var2>] = <var1>, truncated to a byte */ \
+	X(OP_LOAD_SHORT)	/* same for short arrays */ \
+	X(OP_STORE_SHORT) \
+	X(OP_LOAD_BIT)		/* same for bit arrays (the lowest bit is stored) */ \
+	X(OP_STORE_BIT) \
+	X(OP_READ_ARRAY)	/* read all elements of <array> of <var> bits */ \
+	X(OP_WRITE_ARRAY)	/* write all elements of <array> of <var> bits */ \
+	X(OP_WRITELN_ARRAY)	/*   same, the last one followed by a newline */ \
+	X(OP_ARRAY_OP)		/* <array> = <x> <op> <y> elementwise, args: <var> form (see parser.c), x, y, array */ \
+	\
+	X(OP_ADD_VVV)		/* var3 = var1 + var2 */ \
+	X(OP_ADD_VVA)		/* var3 = var1 + <arr2>[var2] */ \
+	X(OP_ADD_VAA)		/* <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3] */ \
+	X(OP_ADD_AVV)		/* <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3] */ \
+	X(OP_ADD_AVA)		/* <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3] */ \
+	X(OP_ADD_AAA)		/* <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3] */ \
+	X(OP_SUB_VVV)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_SUB_VVA)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_SUB_VAA)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_SUB_AVV)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_SUB_AVA)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_SUB_AAA)		/* <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3] */ \
+	X(OP_MUL)			/* reg1 = reg1 * reg2 */ \
+	X(OP_DIV)			/* reg1 = reg1 / reg2 */ \
+	X(OP_MOD)			/* reg1 = reg1 % reg2 */ \
+	\
+	X(OP_EQ_VV)			/* jump if not <var1> == <var2> */ \
+	X(OP_EQ_VA)			/* jump if not <var1> == array[<var2>] */ \
+	X(OP_EQ_AA)			/* jump if not array1[<var1>] == array2[<var2>] */ \
+	X(OP_NEQ_VV)		/* jump if not <var1> != <var2> */ \
+	X(OP_NEQ_VA)		/* jump if not <var1> != array[<var2>] */ \
+	X(OP_NEQ_AA)		/* jump if not array1[<var1>] != array2[<var2>] */ \
+	X(OP_LE_VV)			/* jump if not var1 <= var */ \
+	X(OP_LE_VA)			/* jump if not reg1 <= reg2 */ \
+	X(OP_LE_AV)			/* jump if not reg1 <= reg2 */ \
+	X(OP_LE_AA)			/* jump if not reg1 <= reg2 */ \
+	X(OP_LT_VV)			/* jump if not var1 < var */ \
+	X(OP_LT_VA)			/* jump if not reg1 < reg2 */ \
+	X(OP_LT_AV)			/* jump if not reg1 < reg2 */ \
+	X(OP_LT_AA)			/* jump if not reg1 < reg2 */
+
+#define OPCODE_ENUM(op) op,
+
 typedef enum {
-	OP_WRITE = 0,		// write reg1
-	OP_WRITELN,			// writeln reg1
-	OP_READ,			// reg1 = read
-	OP_LOAD1_V,			// reg1 = <var>
-	OP_LOAD1_A,			// reg1 = <array>[<var>]
-	OP_LOAD2_V,			// reg2 = <var>
-	OP_LOAD2_A,			// reg2 = <array>[<var>]
-	OP_STORE_V,			// <var> = reg1
-	OP_STORE_A,			// <array>[<var>] = reg1
-	OP_ASSIGN_VV,
-	OP_ASSIGN_VA,
-	OP_ASSIGN_AV,
-	OP_ASSIGN_AA,
-	OP_INC_V,			// <var>++
-	OP_INC_A,			// <array>[<var>]++
-	OP_DEC_V,			// <var>--
-	OP_DEC_A,			// <array>[<var>]--
-	OP_JUMP,			// jump <n>
-	OP_RAND,			// reg1 = random
-	OP_NEW,				// <array> = malloc reg1
-	OP_FREE,			// free <array>
-	OP_SIZE,			// reg1 = size <array>
-	OP_HALT,			// stop execution
-
-	OP_ADD_VVV,			// var3 = var1 + var2
-	OP_ADD_VVA,			// var3 = var1 + <arr2>[var2]
-	OP_ADD_VAA,			// <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3]
-	OP_ADD_AVV,			// <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3]
-	OP_ADD_AVA,			// <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3]
-	OP_ADD_AAA,			// <arr1>[<var1>] = <arr2>[var2] + <arr3>[var3]
-	OP_SUB_VVV,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_SUB_VVA,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_SUB_VAA,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_SUB_AVV,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_SUB_AVA,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_SUB_AAA,			// <arr1>[<var1>] = <arr2>[var2] - <arr3>[var3]
-	OP_MUL,				// reg1 = reg1 * reg2
-	OP_DIV,				// reg1 = reg1 / reg2
-	OP_MOD,				// reg1 = reg1 % reg2
-
-	OP_EQ_VV,			// jump if not <var1> == <var2>
-	OP_EQ_VA,			// jump if not <var1> == array[<var2>]
-	OP_EQ_AA,			// jump if not array1[<var1>] == array2[<var2>]
-	OP_NEQ_VV,			// jump if not <var1> != <var2>
-	OP_NEQ_VA,			// jump if not <var1> != array[<var2>]
-	OP_NEQ_AA,			// jump if not array1[<var1>] != array2[<var2>]
-	OP_LE_VV,			// jump if not var1 <= var
-	OP_LE_VA,			// jump if not reg1 <= reg2
-	OP_LE_AV,			// jump if not reg1 <= reg2
-	OP_LE_AA,			// jump if not reg1 <= reg2
-	OP_LT_VV,			// jump if not var1 < var
-	OP_LT_VA,			// jump if not reg1 < reg2
-	OP_LT_AV,			// jump if not reg1 < reg2
-	OP_LT_AA,			// jump if not reg1 < reg2
+	OPCODES(OPCODE_ENUM)
+	OP_COUNT,			// number of opcodes (not an instruction)
 } Opcode;
 
+// Words of the thread layout, tagged in the 2 lower bits
+typedef int32_t Word;
+
+enum { TAG_OPCODE, TAG_JUMP, TAG_VAR, TAG_ARRAY };
+
+#define WORD(tag, value) ((Word)((uint32_t)(value) << 2 | (tag)))
+#define WORD_TAG(word) ((word) & 3)
+#define WORD_VALUE(word) ((word) >> 2)		// arithmetic shift, keeps the sign of jumps
+
 typedef struct bc_instruction {
 	Opcode opcode;
 	int n;
-	int* args[6];
+	Word args[12];		// variable/array slots
 	int arg_n;
-	void** thread_pos;
-	int exec_count;
+	int line;			// of the statement that generated it
 }* BCInstruction;
 
+// Thread positions [start, end) of the code of a while loop (with its bulk instructions)
+typedef struct {
+	int start, end;
+	int line;
+} LoopRange;
+
+// Time of each phase of parser_compile, in seconds
+typedef struct {
+	double parse;
+	double parallel;	// parallel_analyze
+	double idioms;		// idiom_match, idiom_prefetch
+	double codegen;		// without the idioms
+	double jumps;		// break/continue targets
+	double assemble;
+} CompileTimes;
+
+// A compiled program, independent of the memory it runs on. It has the layout of the
+// thread, one Word per thread entry: opcodes, jump targets relative to the jump word,
+// variable slots in a single frame of ints, and array slots. Any number of
+// Runtimes can be created from the same Bytecode.
+typedef struct bytecode {
+	int var_n;
+	int array_n;
+	int args_array;		// slot of the "!args" array
+	int word_n;
+	Word* values;		// initial values of the frame (the constants), var_n of them
+	Word* words;		// word_n
+	uint64_t source_hash;
+	bool parallel;		// compiled with parallel loops
+	int* lines;			// source line (1-based) of each word, for profiles
+	LoopRange* loops;	// all while loops, ordered by start (so outer before inner)
+	int loop_n;
+	char* names;		// '\0' terminated names of the variables (constants are their value), then of the arrays
+	int names_size;
+	String* var_names;	// pointing in names, set by parser_index_names
+	String* array_names;
+	CompileTimes compile_times;		// zero if loaded from a cache
+
+	void* mapping;		// when loaded from a cache file (see cache.h), values/words point in this mmap'ed region
+	size_t mapping_size;
+}* Bytecode;
+
+// Output and input of a running program
 typedef struct {
-	Vector code;
-	Set allocs;			// set of alloced memory
-	bool verbose;
+	void (*write)(void* data, const char* buf, int len);
+	bool (*read)(void* data, int* value);		// false if no more input
+	int (*read_n)(void* data, int* values, int n);	// optional, reads up to n values, returns how many
+	void* data;
+} IO;
+
+#define OUTPUT_BUFFER_SIZE 4096
 
-	// only used during parsing
-	Map variables;		// name => int
-	Map arrays;			// name => Vector of int
+// An instance of a Bytecode, with its own memory
+typedef struct runtime {
+	Bytecode bytecode;
+	void** thread;		// the threaded code that is executed
+	int thread_n;
+	int* frame;			// all variables
+	int* placeholders;	// initial (empty) arrays
+	Set allocs;			// set of alloced arrays
+	Set huge_allocs;	// set of arrays mapped for huge pages
+	size_t huge_threshold;	// arrays of at least that many bytes are mapped for huge pages, 0 disables
+	bool hugetlb;		// map them with MAP_HUGETLB (reserved pages), falling back to transparent huge pages
+	int huge_n;			// arrays mapped for huge pages since the last reset
+	int hugetlb_n;		//   of which with MAP_HUGETLB
+	size_t huge_bytes;
+	IO io;
+	uint64_t rand_state;
+	size_t memory_limit;	// max bytes of arrays, 0 for no limit
+	size_t memory_used;
+	int parallel_n;		// threads for the parallel loops, <= 1 runs them sequentially
+	int prefetch;		// distance (in iterations) of OP_PREFETCH, 0 disables
+	struct pool* pool;	// worker threads of the parallel loops, created on first use
+	int out_n;
+	char out[OUTPUT_BUFFER_SIZE];	// output is buffered here before io.write
+	bool profile;		// count the executions of each instruction, set before interpreter_reset
+	bool profile_blocks;		// with profile, count only the first instruction of each basic block
+	bool* leaders;				// when profiling blocks, whether each thread position starts a block
+	uint64_t* exec_count;		// when profiling, per thread position
+	void** profile_targets;		// when profiling, the instruction at each thread position (see OP_PROFILED)
+	struct counters* counters;	// loop nest counters (see counters.h), set before interpreter_reset
+
+	// statistics of the last run
+	size_t memory_peak;		// max of memory_used
+	uint64_t output_bytes;
+	int new_n, free_n;		// OP_NEW, OP_FREE executed
+	double patch_time;		// seconds spent replacing their arrays in the thread
 }* Runtime;
 
+// Variable of a parallel loop updated only as  var = var + x  (or -, or * if mul)
+typedef struct reduction {
+	String var;
+	bool mul;
+	struct reduction* next;
+}* Reduction;
+
+// A while loop whose iterations can be executed in parallel (see parallel.h)
+typedef struct parallel_loop {
+	String counter, bound;		// while counter < bound, or <= if inclusive
+	bool inclusive;
+	Reduction reductions;
+}* ParallelLoop;
+
+// Element of a loop read (or written) with an affine index, prefetched ahead (see idiom.h)
+typedef struct prefetch {
+	String index, array;
+	struct prefetch* next;
+}* Prefetch;
+
 typedef struct statement {
 	StatementType type;
 	String tokens[6];
 	Program body, else_body;
 	int start_pos, end_pos;		// start/end position in code
+	struct statement* next;		// next statement in the same block
+	ParallelLoop parallel;		// for loops found by parallel_analyze
+	Prefetch prefetch;			// elements accessed by the statement, found by idiom_prefetch
+	int line;					// in the source, 1-based
 }* Statement;
 
+#define PARSER_ERROR_SIZE 256
+
+// Max nesting of if/while/else bodies. The compile passes recurse once per level, so
+// deeper programs are rejected instead of overflowing the (worker thread's) stack.
+#define PARSER_MAX_DEPTH 1000
+
+// Compiles a source file (vector of strings). On error NULL is returned and a message
+// is stored in error (PARSER_ERROR_SIZE chars). The source lines are modified.
+// If parallel is true, the loops found by parallel_analyze are compiled as parallel.
+
+Bytecode parser_compile(Vector source, bool parallel, String error);
 
-// Parses a source file (vector of strings) into a program
+void parser_destroy_bytecode(Bytecode bytecode);
 
-Runtime parser_create_runtime(Vector source, Vector args, bool verbose);
+uint64_t parser_source_hash(Vector source);
 
-void parser_destroy_runtime(Runtime runtime);
+// Sets bytecode's var_names, array_names from its names. Returns false if names does not
+// contain exactly var_n + array_n names.
+bool parser_index_names(Bytecode bytecode);
 
-int* parser_alloc(int int_n, Runtime runtime);
-void parser_free(Pointer p, Runtime runtime);
\ No newline at end of file
+bool is_jump(Opcode opcode);
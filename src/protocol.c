@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+typedef struct {
+	char type;
+	uint32_t size;
+} __attribute__((packed)) MessageHeader;
+
+
+static bool send_all(int fd, const void* buf, size_t size) {
+	for(const char* p = buf; size > 0; ) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);	// no SIGPIPE if the other side is gone
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool receive_all(int fd, void* buf, size_t size) {
+	for(char* p = buf; size > 0; ) {
+		ssize_t n = recv(fd, p, size, 0);
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool protocol_send(int fd, MessageType type, const void* data, uint32_t size) {
+	MessageHeader header = { .type = type, .size = size };
+	return send_all(fd, &header, sizeof(header)) && send_all(fd, data, size);
+}
+
+bool protocol_receive(int fd, MessageType* type, char** data, uint32_t* size) {
+	MessageHeader header;
+	if(!receive_all(fd, &header, sizeof(header)) || header.size > PROTOCOL_MAX_SIZE)
+		return false;
+
+	*data = malloc(header.size + 1);
+	if(!receive_all(fd, *data, header.size)) {
+		free(*data);
+		return false;
+	}
+	(*data)[header.size] = '\0';
+	*type = header.type;
+	*size = header.size;
+	return true;
+}
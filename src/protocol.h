@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Messages between ipli-client and the server (see server.h), over a Unix socket.
+// Each message is a type byte and a 32-bit payload size, followed by the payload.
+//
+// The client sends a MSG_REQUEST, and the MSG_SOURCE if the server asks for it
+// (the program is not in the server's cache). The server then sends the output of
+// the run, asks for input whenever the program reads, and finishes with MSG_EXIT.
+// The client answers a MSG_NEED_INPUT with the values asked for and the ones already
+// available (so that reading a long input costs few round trips), the server keeps the
+// values that the program has not read yet for its next reads.
+
+typedef enum {
+	MSG_REQUEST = 'R',		// client: RequestHeader followed by the arguments (each NUL-terminated)
+	MSG_SOURCE = 'P',		// client: the program's text
+	MSG_INPUT = 'I',		// client: one or more int32_t, the answer to MSG_NEED_INPUT
+	MSG_NO_INPUT = 'E',		// client: no more input, the answer to MSG_NEED_INPUT
+	MSG_NEED_SOURCE = 'S',	// server: the program is not in the cache
+	MSG_NEED_INPUT = 'N',	// server: the program executes read, a uint32_t number of values it needs
+	MSG_OUTPUT = 'O',		// server: output of the program
+	MSG_EXIT = 'X',			// server: an int32_t exit code, followed by a message
+} MessageType;
+
+typedef struct {
+	uint64_t source_hash;		// see parser_source_hash
+	uint32_t time_limit_ms;		// 0 for the server's default
+	uint32_t memory_limit_mb;	// 0 for the server's default
+} RequestHeader;
+
+#define PROTOCOL_MAX_SIZE (256 << 20)
+
+bool protocol_send(int fd, MessageType type, const void* data, uint32_t size);
+
+// Receives a message, its payload (NUL-terminated, size does not include the NUL)
+// is malloc'ed and stored in *data. Returns false on error or end of connection.
+bool protocol_receive(int fd, MessageType* type, char** data, uint32_t* size);
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "report.h"
+#include "interpreter.h"
+
+typedef struct {
+	uint64_t dispatches, samples;
+} Counts;
+
+// State of a report
+typedef struct {
+	Bytecode bytecode;
+	Vector source;
+	uint64_t* exec_count;
+	uint64_t* samples;
+	Counts* lines;			// per source line, 0 for the instructions of no statement
+	int line_n;
+	Counts total;
+	int* instrs;			// thread positions of the instructions, ordered by line
+	int instr_n;
+	FILE* out;
+} Report;
+
+static int line_of(Report* report, int pos) {
+	int line = report->bytecode->lines[pos];
+	return line >= 1 && line <= report->line_n ? line : 0;
+}
+
+// the instructions of no statement are reported last, as line line_n + 1
+static int order_of(Report* report, int pos) {
+	int line = line_of(report, pos);
+	return line > 0 ? line : report->line_n + 1;
+}
+
+static Report* sorting;		// for compare_instrs, qsort has no context argument
+
+static int compare_instrs(const void* a, const void* b) {
+	int x = *(const int*)a, y = *(const int*)b;
+	int ox = order_of(sorting, x), oy = order_of(sorting, y);
+	return ox != oy ? ox - oy : x - y;
+}
+
+static double time_share(Report* report, Counts counts) {
+	return
+		report->total.samples > 0 ? (double)counts.samples / report->total.samples :
+		report->total.dispatches > 0 ? (double)counts.dispatches / report->total.dispatches :
+		0;
+}
+
+// the source line without its newline
+static int source_length(String line) {
+	int length = strlen(line);
+	while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+		length--;
+	return length;
+}
+
+static void write_json_string(FILE* out, const char* s, int length) {
+	fputc('"', out);
+	for(int i = 0; i < length; i++) {
+		unsigned char c = s[i];
+		if(c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if(c == '\t')
+			fprintf(out, "\\t");
+		else if(c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static void write_text(Report* report) {
+	FILE* out = report->out;
+	fprintf(out, "%" PRIu64 " dispatches, %" PRIu64 " samples, time shares from the %s\n",
+		report->total.dispatches, report->total.samples, report->total.samples > 0 ? "samples" : "dispatches");
+	fprintf(out, "%6s %14s %7s  %s\n", "line", "dispatches", "time", "source");
+
+	int k = 0;
+	for(int order = 1; order <= report->line_n + 1; order++) {
+		int line = order <= report->line_n ? order : 0;
+		bool has_code = k < report->instr_n && order_of(report, report->instrs[k]) == order;
+		Counts counts = report->lines[line];
+		if(line == 0 && !has_code)
+			break;
+
+		String source = line > 0 ? vector_get_at(report->source, line - 1) : "(no statement)";
+		if(has_code)
+			fprintf(out, "%6d %14" PRIu64 " %6.2f%%  ", line, counts.dispatches, 100 * time_share(report, counts));
+		else
+			fprintf(out, "%6d %14s %7s  ", line, "", "");
+		fprintf(out, "%.*s\n", source_length(source), source);
+
+		for(; k < report->instr_n && order_of(report, report->instrs[k]) == order; k++) {
+			int pos = report->instrs[k];
+			fprintf(out, "%31d  ", pos);
+			print_instruction(report->bytecode, pos, out);
+			if(report->exec_count != NULL)
+				fprintf(out, "  (%" PRIu64 ")", report->exec_count[pos]);
+			if(report->samples != NULL)
+				fprintf(out, "  [%" PRIu64 " samples]", report->samples[pos]);
+			fprintf(out, "\n");
+		}
+	}
+}
+
+static void write_json_instruction(Report* report, int pos) {
+	FILE* out = report->out;
+	Bytecode bytecode = report->bytecode;
+	fprintf(out, "{\"pos\": %d, \"opcode\": \"%s\", \"operands\": [", pos, interpreter_opcode_name(WORD_VALUE(bytecode->words[pos])));
+	for(int i = pos + 1; i < bytecode->word_n && WORD_TAG(bytecode->words[i]) != TAG_OPCODE; i++) {
+		Word word = bytecode->words[i];
+		fputs(i > pos + 1 ? ", " : "", out);
+		switch(WORD_TAG(word)) {
+			case TAG_JUMP:	fprintf(out, "\"-> %d\"", i + WORD_VALUE(word));	break;
+			case TAG_VAR: {
+				String name = bytecode->var_names[WORD_VALUE(word)];
+				write_json_string(out, name, strlen(name));
+				break;
+			}
+			case TAG_ARRAY: {
+				char name[strlen(bytecode->array_names[WORD_VALUE(word)]) + 3];
+				sprintf(name, "%s[]", bytecode->array_names[WORD_VALUE(word)]);
+				write_json_string(out, name, strlen(name));
+				break;
+			}
+		}
+	}
+	fprintf(out, "], \"dispatches\": %" PRIu64 ", \"samples\": %" PRIu64 "}",
+		report->exec_count != NULL ? report->exec_count[pos] : 0, report->samples != NULL ? report->samples[pos] : 0);
+}
+
+static void write_json(Report* report) {
+	FILE* out = report->out;
+	fprintf(out, "{\"dispatches\": %" PRIu64 ", \"samples\": %" PRIu64 ", \"lines\": [", report->total.dispatches, report->total.samples);
+
+	int k = 0;
+	for(int order = 1; order <= report->line_n + 1; order++) {
+		int line = order <= report->line_n ? order : 0;
+		Counts counts = report->lines[line];
+		String source = line > 0 ? vector_get_at(report->source, line - 1) : "";
+		fprintf(out, "%s\n{\"line\": %d, \"source\": ", order > 1 ? "," : "", line);
+		write_json_string(out, source, source_length(source));
+		fprintf(out, ", \"dispatches\": %" PRIu64 ", \"samples\": %" PRIu64 ", \"time_share\": %.6f, \"instructions\": [",
+			counts.dispatches, counts.samples, time_share(report, counts));
+
+		for(bool first = true; k < report->instr_n && order_of(report, report->instrs[k]) == order; k++, first = false) {
+			fputs(first ? "" : ", ", out);
+			write_json_instruction(report, report->instrs[k]);
+		}
+		fprintf(out, "]}");
+	}
+	fprintf(out, "\n]}\n");
+}
+
+void report_annotate(Bytecode bytecode, Vector source, uint64_t* exec_count, uint64_t* samples, bool json, FILE* out) {
+	Report report = {
+		.bytecode = bytecode,
+		.source = source,
+		.exec_count = exec_count,
+		.samples = samples,
+		.line_n = vector_size(source),
+		.out = out,
+	};
+	report.lines = calloc(report.line_n + 1, sizeof(*report.lines));
+	report.instrs = malloc(bytecode->word_n * sizeof(*report.instrs));
+
+	for(int i = 0; i < bytecode->word_n; i++) {
+		if(WORD_TAG(bytecode->words[i]) != TAG_OPCODE)
+			continue;
+		report.instrs[report.instr_n++] = i;
+		Counts* counts = &report.lines[line_of(&report, i)];
+		counts->dispatches += exec_count != NULL ? exec_count[i] : 0;
+		counts->samples += samples != NULL ? samples[i] : 0;
+	}
+	for(int i = 0; i <= report.line_n; i++) {
+		report.total.dispatches += report.lines[i].dispatches;
+		report.total.samples += report.lines[i].samples;
+	}
+	sorting = &report;
+	qsort(report.instrs, report.instr_n, sizeof(*report.instrs), compare_instrs);
+
+	if(json)
+		write_json(&report);
+	else
+		write_text(&report);
+
+	free(report.lines);
+	free(report.instrs);
+}
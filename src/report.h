@@ -0,0 +1,25 @@
+
+#pragma once
+
+#include <stdio.h>
+
+#include "parser.h"
+
+// Annotated source report of a run. Each source line is printed with the dispatches of
+// its instructions and its share of the run time, followed by its instructions (with
+// the names of their operands). A line's instructions are those generated by its
+// statement, a while's test at the end of the loop belongs to the while.
+//
+// exec_count are the dispatches of each instruction (by thread position, see
+// Runtime.exec_count) and samples the samples of each instruction (see sampler_counts),
+// either can be NULL. The time share is from the samples if there are any, otherwise it
+// is estimated as the share of the dispatches.
+//
+// With json, the same data is written as a JSON object:
+//
+//   {"dispatches": N, "samples": N, "lines": [{"line": 1, "source": "...", "dispatches": N,
+//     "samples": N, "time_share": 0.25, "instructions": [{"pos": 0, "opcode": "OP_ADD_VVV",
+//     "operands": ["i", "i", "1"], "dispatches": N, "samples": N}, ...]}, ...]}
+//
+// where the last line, numbered 0, holds the instructions of no statement (eg the final OP_HALT).
+void report_annotate(Bytecode bytecode, Vector source, uint64_t* exec_count, uint64_t* samples, bool json, FILE* out);
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "sampler.h"
+
+// State of the handler, set before the timer starts
+static Runtime sampled;
+static uint64_t* counts;		// per thread position (including the end)
+static uint64_t unknown;		// samples outside of the runtime's threads (eg while reading the source)
+static struct sigaction old_action;
+
+
+static void handle_sample(int signal) {
+	// the run executing in the thread that got the signal (the main one or a parallel worker)
+	void*** ip = interpreter_ip;
+	int pos;
+	if(ip != NULL && interpreter_position(sampled, *(void** volatile*)ip, &pos))
+		__atomic_fetch_add(&counts[pos], 1, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_add(&unknown, 1, __ATOMIC_RELAXED);
+}
+
+void sampler_start(Runtime runtime, int hz) {
+	sampled = runtime;
+	counts = calloc(runtime->thread_n + 1, sizeof(*counts));
+	unknown = 0;
+
+	struct sigaction action = { .sa_handler = handle_sample, .sa_flags = SA_RESTART };
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, &old_action);
+
+	int usec = 1000000 / (hz > 0 ? hz : 1);
+	struct itimerval timer = { .it_interval = { usec / 1000000, usec % 1000000 } };
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void sampler_stop(void) {
+	struct itimerval timer = { 0 };
+	setitimer(ITIMER_PROF, &timer, NULL);
+	sigaction(SIGPROF, &old_action, NULL);
+}
+
+
+// Report ////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+	int pos;			// of the instruction's opcode
+	uint64_t count;
+} Entry;
+
+static int compare_entries(const void* a, const void* b) {
+	const Entry* x = a;
+	const Entry* y = b;
+	return x->count != y->count ? (x->count < y->count ? 1 : -1) : x->pos - y->pos;
+}
+
+uint64_t* sampler_counts(uint64_t* unknown_n) {
+	Bytecode bytecode = sampled->bytecode;
+
+	// the instruction of a position is the last opcode strictly before it, ip is past the
+	// opcode while the instruction executes (and at the next one before its dispatch)
+	uint64_t* instr_counts = calloc(bytecode->word_n, sizeof(*instr_counts));
+	int instr = 0;
+	for(int i = 1; i <= bytecode->word_n; i++) {
+		if(WORD_TAG(bytecode->words[i - 1]) == TAG_OPCODE)
+			instr = i - 1;
+		instr_counts[instr] += counts[i];
+	}
+	*unknown_n = unknown;
+	return instr_counts;
+}
+
+void sampler_report(FILE* flat, FILE* folded) {
+	Bytecode bytecode = sampled->bytecode;
+	uint64_t total;
+	uint64_t* instr_counts = sampler_counts(&total);
+	for(int i = 0; i < bytecode->word_n; i++)
+		total += instr_counts[i];
+
+	Entry* entries = malloc(bytecode->word_n * sizeof(*entries));
+	int entry_n = 0;
+	for(int i = 0; i < bytecode->word_n; i++)
+		if(instr_counts[i] > 0)
+			entries[entry_n++] = (Entry){ i, instr_counts[i] };
+	qsort(entries, entry_n, sizeof(*entries), compare_entries);
+
+	fprintf(flat, "%" PRIu64 " samples, %" PRIu64 " unknown\n", total, unknown);
+	fprintf(flat, "%10s %7s %6s %6s  %s\n", "samples", "%", "line", "pos", "instruction");
+	for(int i = 0; i < entry_n; i++) {
+		int pos = entries[i].pos;
+		fprintf(flat, "%10" PRIu64 " %6.2f%% %6d %6d  %s\n", entries[i].count, 100.0 * entries[i].count / total,
+			bytecode->lines[pos], pos, interpreter_opcode_name(WORD_VALUE(bytecode->words[pos])));
+	}
+
+	// loops are sorted outer first, so the enclosing ones of an instruction are in nesting order
+	if(folded != NULL) {
+		for(int i = 0; i < entry_n; i++) {
+			int pos = entries[i].pos;
+			fprintf(folded, "ipl");
+			for(int j = 0; j < bytecode->loop_n; j++)
+				if(bytecode->loops[j].start <= pos && pos < bytecode->loops[j].end)
+					fprintf(folded, ";while@%d", bytecode->loops[j].line);
+			fprintf(folded, ";%s@%d %" PRIu64 "\n", interpreter_opcode_name(WORD_VALUE(bytecode->words[pos])), bytecode->lines[pos], entries[i].count);
+		}
+		if(unknown > 0)
+			fprintf(folded, "ipl;[unknown] %" PRIu64 "\n", unknown);
+	}
+
+	free(entries);
+	free(instr_counts);
+	free(counts);
+	counts = NULL;
+	sampled = NULL;
+}
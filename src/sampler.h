@@ -0,0 +1,34 @@
+
+#pragma once
+
+#include <stdio.h>
+
+#include "interpreter.h"
+
+// Sampling profiler. A SIGPROF timer interrupts the process hz times per second of CPU
+// time, and the handler reads the ip of the interrupted run (see interpreter_ip), so the
+// interpreter itself does no extra work. The handler only increments the count of that
+// thread position.
+//
+// The counts are then attributed to the instruction containing each position, and
+// reported as a flat profile and as folded stacks of the enclosing while loops, the
+// input format of flamegraph.pl:
+//
+//   ipl;while@3;while@7;OP_ADD_VVV@9 523
+//
+// (frames are the loops' and the instruction's source lines). Only one runtime at a time
+// can be sampled.
+
+// Starts sampling runtime (which should be reset, with the thread relocated)
+void sampler_start(Runtime runtime, int hz);
+
+// Stops the timer, the samples are kept for the report
+void sampler_stop(void);
+
+// Returns the samples of each instruction, by the thread position of its opcode (word_n
+// counts, to be freed by the caller), and stores the samples outside of the thread in unknown.
+uint64_t* sampler_counts(uint64_t* unknown);
+
+// Writes the flat profile to flat, and the folded stacks to folded (if not NULL).
+// Frees the samples.
+void sampler_report(FILE* flat, FILE* folded);
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "protocol.h"
+#include "interpreter.h"
+
+// max wait for the request and the source, so that an idle client cannot hold a worker
+#define RECEIVE_TIMEOUT_MS 10000
+// max wait for a client to accept more output, after which it is considered gone
+#define SEND_TIMEOUT_MS 10000
+// after its deadline, a run stuck sending output to a client gets this long to finish
+// before the connection is shut down in both directions
+#define SHUTDOWN_GRACE_MS 1000
+
+typedef struct cache_entry {
+	uint64_t source_hash;				// the key in the map
+	Bytecode bytecode;
+	int refs;							// number of runs using the bytecode
+	struct cache_entry *prev, *next;	// in the LRU list
+}* CacheEntry;
+
+typedef struct server* Server;
+
+typedef struct worker {
+	Server server;
+	int id;
+	pthread_t thread;
+	// the current run, protected by server->lock (accessed by the watchdog)
+	int fd;
+	Runtime runtime;
+	struct timespec deadline;
+	bool timed_out;
+} *Worker;
+
+struct server {
+	ServerOptions options;
+	int listen_fd;
+	pthread_mutex_t lock;				// protects the cache and the runs of the workers
+	Map cache;							// source_hash => CacheEntry
+	struct cache_entry lru;				// sentinel of the LRU list, lru.next is the most recent
+	struct worker* workers;
+};
+
+typedef struct {
+	int fd;
+	bool broken;		// the client is gone
+	Runtime runtime;	// interrupted when the client is gone
+	int32_t* input;		// the last MSG_INPUT, input[input_pos, input_n) are not read yet
+	uint32_t input_n, input_pos;
+} Connection;
+
+
+// Cache //////////////////////////////////////////////////////////////////////////
+
+static int compare_hashes(Pointer a, Pointer b) {
+	uint64_t x = *(uint64_t*)a, y = *(uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint hash_hash(Pointer value) {
+	uint64_t x = *(uint64_t*)value;		// already a hash
+	return x ^ (x >> 32);
+}
+
+static void lru_unlink(CacheEntry entry) {
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+static void lru_push_front(Server server, CacheEntry entry) {
+	entry->prev = &server->lru;
+	entry->next = server->lru.next;
+	entry->prev->next = entry->next->prev = entry;
+}
+
+// removes the least recently used programs that are not running, while the cache is full
+static void cache_evict(Server server) {
+	for(CacheEntry entry = server->lru.prev; entry != &server->lru && map_size(server->cache) > server->options.cache_size; ) {
+		CacheEntry prev = entry->prev;
+		if(entry->refs == 0) {
+			lru_unlink(entry);
+			map_remove(server->cache, &entry->source_hash);
+			parser_destroy_bytecode(entry->bytecode);
+			free(entry);
+		}
+		entry = prev;
+	}
+}
+
+// Returns the entry of source_hash (to be released with cache_release), or NULL
+static CacheEntry cache_acquire(Server server, uint64_t source_hash) {
+	pthread_mutex_lock(&server->lock);
+	CacheEntry entry = map_find(server->cache, &source_hash);
+	if(entry != NULL) {
+		entry->refs++;
+		lru_unlink(entry);
+		lru_push_front(server, entry);
+	}
+	pthread_mutex_unlock(&server->lock);
+	return entry;
+}
+
+// Inserts a newly compiled bytecode, returns its (acquired) entry
+static CacheEntry cache_insert(Server server, Bytecode bytecode) {
+	pthread_mutex_lock(&server->lock);
+	CacheEntry entry = map_find(server->cache, &bytecode->source_hash);
+	if(entry != NULL) {
+		// compiled by another worker meanwhile
+		parser_destroy_bytecode(bytecode);
+		lru_unlink(entry);
+	} else {
+		entry = calloc(1, sizeof(*entry));
+		entry->source_hash = bytecode->source_hash;
+		entry->bytecode = bytecode;
+		map_insert(server->cache, &entry->source_hash, entry);
+	}
+	entry->refs++;
+	lru_push_front(server, entry);
+	cache_evict(server);
+	pthread_mutex_unlock(&server->lock);
+	return entry;
+}
+
+static void cache_release(Server server, CacheEntry entry) {
+	pthread_mutex_lock(&server->lock);
+	entry->refs--;
+	cache_evict(server);
+	pthread_mutex_unlock(&server->lock);
+}
+
+
+// Requests ///////////////////////////////////////////////////////////////////////
+
+static void connection_write(void* data, const char* buf, int len) {
+	Connection* conn = data;
+	if(!conn->broken && !protocol_send(conn->fd, MSG_OUTPUT, buf, len)) {
+		conn->broken = true;
+		interpreter_interrupt(conn->runtime);		// no one reads the rest of the output
+	}
+}
+
+// Asks the client for (at least) wanted values, returns false if there are no more
+static bool receive_input(Connection* conn, uint32_t wanted) {
+	free(conn->input);
+	conn->input = NULL;
+	conn->input_n = conn->input_pos = 0;
+
+	MessageType type;
+	char* payload;
+	uint32_t size;
+	if(conn->broken || !protocol_send(conn->fd, MSG_NEED_INPUT, &wanted, sizeof(wanted)) || !protocol_receive(conn->fd, &type, &payload, &size)) {
+		conn->broken = true;
+		return false;
+	}
+	if(type != MSG_INPUT || size == 0 || size % sizeof(int32_t) != 0) {
+		free(payload);
+		return false;
+	}
+	conn->input = (int32_t*)payload;		// malloc'ed, so aligned
+	conn->input_n = size / sizeof(int32_t);
+	return true;
+}
+
+static int connection_read_n(void* data, int* values, int n) {
+	Connection* conn = data;
+	int k = 0;
+	while(k < n && (conn->input_pos < conn->input_n || receive_input(conn, n - k))) {
+		int m = n - k < conn->input_n - conn->input_pos ? n - k : conn->input_n - conn->input_pos;
+		memcpy(values + k, conn->input + conn->input_pos, m * sizeof(*values));
+		conn->input_pos += m;
+		k += m;
+	}
+	return k;
+}
+
+static bool connection_read(void* data, int* value) {
+	return connection_read_n(data, value, 1) == 1;
+}
+
+static void send_exit(int fd, int32_t code, String message) {
+	int size = sizeof(code) + strlen(message);
+	char payload[size];
+	memcpy(payload, &code, sizeof(code));
+	memcpy(payload + sizeof(code), message, size - sizeof(code));
+	protocol_send(fd, MSG_EXIT, payload, size);
+}
+
+static void set_timeout(int fd, int option, uint32_t timeout_ms) {
+	struct timeval timeout = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+// the lower non-zero limit
+static uint32_t limit(uint32_t server_limit, uint32_t request_limit) {
+	return server_limit == 0 || (request_limit != 0 && request_limit < server_limit) ? request_limit : server_limit;
+}
+
+// Receives the source and compiles it, returns NULL (after informing the client) on error
+static CacheEntry compile_request(Worker worker, int fd) {
+	MessageType type;
+	char* source;
+	uint32_t size;
+	if(!protocol_send(fd, MSG_NEED_SOURCE, NULL, 0) || !protocol_receive(fd, &type, &source, &size))
+		return NULL;
+	if(type != MSG_SOURCE) {
+		free(source);
+		return NULL;
+	}
+
+	// split in lines like getline does (keeping the '\n'), so that the hash is the client's
+	Vector lines = vector_create(0, NULL);
+	for(char* line = source; *line != '\0'; ) {
+		char* newline = strchr(line, '\n');
+		char* next = newline != NULL ? newline + 1 : line + strlen(line);
+		vector_insert_last(lines, strndup(line, next - line));
+		line = next;
+	}
+	vector_set_destroy_value(lines, free);
+	free(source);
+
+	char error[PARSER_ERROR_SIZE];
+	Bytecode bytecode = parser_compile(lines, false, error);
+	vector_destroy(lines);
+	if(bytecode == NULL) {
+		send_exit(fd, 1, error);
+		return NULL;
+	}
+	return cache_insert(worker->server, bytecode);
+}
+
+static void serve_request(Worker worker, int fd) {
+	Server server = worker->server;
+
+	MessageType type;
+	char* request;
+	uint32_t size;
+	if(!protocol_receive(fd, &type, &request, &size))
+		return;
+	if(type != MSG_REQUEST || size < sizeof(RequestHeader)) {
+		free(request);
+		return;
+	}
+
+	RequestHeader header;
+	memcpy(&header, request, sizeof(header));
+
+	// the arguments are NUL-terminated strings after the header
+	int arg_n = 0;
+	String* args = malloc((size - sizeof(header) + 1) * sizeof(*args));		// at most one per byte
+	for(char* arg = request + sizeof(header); arg < request + size; arg += strlen(arg) + 1)
+		args[arg_n++] = arg;
+
+	CacheEntry entry = cache_acquire(server, header.source_hash);
+	if(entry == NULL)
+		entry = compile_request(worker, fd);
+	if(entry == NULL) {
+		free(args);
+		free(request);
+		return;
+	}
+
+	// the run waits for input without a timeout, it is bounded by its time limit (if any)
+	set_timeout(fd, SO_RCVTIMEO, 0);
+
+	Connection conn = { .fd = fd };
+	IO io = { .write = connection_write, .read = connection_read, .read_n = connection_read_n, .data = &conn };
+	Runtime runtime = interpreter_create_runtime(entry->bytecode, io, time(NULL) ^ ((uint64_t)worker->id << 32));
+	conn.runtime = runtime;
+	runtime->memory_limit = (size_t)limit(server->options.memory_limit_mb, header.memory_limit_mb) << 20;
+	interpreter_reset(runtime, arg_n, args);
+
+	// the watchdog interrupts the run after its deadline
+	uint32_t time_limit = limit(server->options.time_limit_ms, header.time_limit_ms);
+	pthread_mutex_lock(&server->lock);
+	if(time_limit != 0) {
+		clock_gettime(CLOCK_MONOTONIC, &worker->deadline);
+		worker->deadline.tv_sec += time_limit / 1000;
+		worker->deadline.tv_nsec += (time_limit % 1000) * 1000000L;
+		worker->runtime = runtime;
+	}
+	worker->fd = fd;
+	worker->timed_out = false;
+	pthread_mutex_unlock(&server->lock);
+
+	RunStatus status = interpreter_run(runtime);
+
+	pthread_mutex_lock(&server->lock);
+	worker->runtime = NULL;
+	bool timed_out = worker->timed_out;
+	pthread_mutex_unlock(&server->lock);
+
+	if(timed_out)
+		send_exit(fd, 2, "time limit exceeded");
+	else if(status != RUN_OK)
+		send_exit(fd, 2, interpreter_status_message(status));
+	else
+		send_exit(fd, 0, "");
+
+	interpreter_destroy_runtime(runtime);
+	free(conn.input);
+	cache_release(server, entry);
+	free(args);
+	free(request);
+}
+
+static void* worker_main(void* arg) {
+	Worker worker = arg;
+	while(true) {
+		int fd = accept(worker->server->listen_fd, NULL, NULL);
+		if(fd == -1)
+			continue;
+		set_timeout(fd, SO_RCVTIMEO, RECEIVE_TIMEOUT_MS);
+		set_timeout(fd, SO_SNDTIMEO, SEND_TIMEOUT_MS);
+		serve_request(worker, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+// Interrupts the runs that exceeded their deadline. A run waiting for input is
+// woken up by shutting down the receiving side of its connection, and a run still
+// blocked sending output SHUTDOWN_GRACE_MS later by shutting down both sides.
+static void* watchdog_main(void* arg) {
+	Server server = arg;
+	struct timespec period = { .tv_nsec = 10 * 1000000L };
+	while(true) {
+		nanosleep(&period, NULL);
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		pthread_mutex_lock(&server->lock);
+		for(int i = 0; i < server->options.thread_n; i++) {
+			Worker worker = &server->workers[i];
+			if(worker->runtime == NULL)
+				continue;
+
+			long long left_ns = (worker->deadline.tv_sec - now.tv_sec) * 1000000000LL + (worker->deadline.tv_nsec - now.tv_nsec);
+			if(left_ns > 0)
+				continue;
+			if(!worker->timed_out) {
+				worker->timed_out = true;
+				interpreter_interrupt(worker->runtime);
+				shutdown(worker->fd, SHUT_RD);
+				worker->deadline.tv_sec += SHUTDOWN_GRACE_MS / 1000;
+				worker->deadline.tv_nsec += (SHUTDOWN_GRACE_MS % 1000) * 1000000L;
+			} else {
+				shutdown(worker->fd, SHUT_RDWR);
+			}
+		}
+		pthread_mutex_unlock(&server->lock);
+	}
+	return NULL;
+}
+
+void server_run(String socket_path, ServerOptions options) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long\n");
+		return;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	struct server server = { .options = options };
+	server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socket_path);		// left by a previous server
+	if(server.listen_fd == -1 || bind(server.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(server.listen_fd, 128) == -1) {
+		perror(socket_path);
+		return;
+	}
+
+	pthread_mutex_init(&server.lock, NULL);
+	server.cache = map_create(compare_hashes, NULL, NULL);
+	map_set_hash_function(server.cache, hash_hash);
+	server.lru.prev = server.lru.next = &server.lru;
+
+	server.workers = calloc(options.thread_n, sizeof(*server.workers));
+	for(int i = 0; i < options.thread_n; i++) {
+		server.workers[i].server = &server;
+		server.workers[i].id = i;
+	}
+	for(int i = 0; i < options.thread_n; i++)
+		pthread_create(&server.workers[i].thread, NULL, worker_main, &server.workers[i]);
+
+	watchdog_main(&server);		// never returns
+}
@@ -0,0 +1,27 @@
+
+#pragma once
+
+#include "parser.h"
+
+// Server mode: listens on a Unix socket for programs to run, sent by ipli-client
+// (see protocol.h for the messages).
+//
+// Compiled programs are kept in an LRU cache keyed by the hash of their source, so
+// a client first sends just the hash and sends the source only on a miss. Requests
+// are served by thread_n worker threads, each run in a new Runtime. A run stops
+// when it exceeds its time limit (wall clock, including waiting for input) or when
+// its arrays exceed its memory limit. A client that is idle before the run (while
+// sending its request or source) is disconnected after RECEIVE_TIMEOUT_MS, and one
+// that stops reading the output after SEND_TIMEOUT_MS (or at the run's time limit).
+
+#define SERVER_SOCKET "/tmp/ipli-fast.sock"		// default, used by ipli-client too
+
+typedef struct {
+	int thread_n;
+	int cache_size;				// max number of compiled programs kept
+	uint32_t time_limit_ms;		// max limits, requests can only ask for lower ones
+	uint32_t memory_limit_mb;	// 0 for no limit
+} ServerOptions;
+
+// Returns only on error (with a message in stderr)
+void server_run(String socket_path, ServerOptions options);